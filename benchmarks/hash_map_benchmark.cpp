@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "flat_hash_map.h"
+#include "hash_map.h"
+#include "pool_allocator.h"
+#include "swiss_hash_map.h"
+
+/**
+ * Compares HashMap against std::unordered_map and the open addressing tables on the basic operations.
+ * Every benchmark runs for integer and string keys and for tables from 1K elements, which stay in L1/L2, up to 4M
+ * elements, which live in DRAM. Keys are scrambled, so neighbouring indices do not give neighbouring hashes, and
+ * misses are looked up with keys from a disjoint set. The Zipf benchmark draws lookups with s = 0.99, so that a few
+ * hot keys get most of the traffic, the way real caches see it.
+ * Run with --benchmark_out=<file> --benchmark_out_format=json (or build the run_benchmarks target) to keep results.
+ */
+
+namespace {
+
+constexpr size_t kQueries = 1 << 16;
+
+uint64_t scramble(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+template<class KeyType>
+struct Keys;
+
+template<>
+struct Keys<uint64_t> {
+    static uint64_t make(uint64_t index) {
+        return scramble(index);
+    }
+};
+
+// Long enough to be allocated outside of the small string buffer.
+template<>
+struct Keys<std::string> {
+    static std::string make(uint64_t index) {
+        return "benchmark-key-" + std::to_string(scramble(index));
+    }
+};
+
+// Keys 0..size-1 are in the table, keys from size on are never inserted.
+template<class KeyType>
+std::vector<KeyType> make_keys(size_t first, size_t count) {
+    std::vector<KeyType> keys;
+    keys.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+        keys.push_back(Keys<KeyType>::make(first + i));
+    return keys;
+}
+
+// Indices in [0, size), drawn from a Zipf distribution by inverting its cumulative distribution.
+std::vector<size_t> zipf_indices(size_t size, size_t count, double s = 0.99) {
+    std::vector<double> cumulative(size);
+    double sum = 0;
+    for (size_t i = 0; i < size; ++i) {
+        sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+        cumulative[i] = sum;
+    }
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> uniform(0, sum);
+    std::vector<size_t> indices(count);
+    for (auto &index : indices) {
+        index = std::lower_bound(cumulative.begin(), cumulative.end(), uniform(rng)) - cumulative.begin();
+        index = std::min(index, size - 1);
+    }
+    // The hottest keys should not all sit in the first buckets.
+    std::vector<size_t> permutation(size);
+    for (size_t i = 0; i < size; ++i)
+        permutation[i] = i;
+    std::shuffle(permutation.begin(), permutation.end(), rng);
+    for (auto &index : indices)
+        index = permutation[index];
+    return indices;
+}
+
+// Lookup keys drawn uniformly from 'keys', kQueries of them.
+template<class KeyType>
+std::vector<KeyType> uniform_queries(const std::vector<KeyType>& keys) {
+    std::mt19937_64 rng(7);
+    std::vector<KeyType> queries;
+    queries.reserve(kQueries);
+    for (size_t i = 0; i < kQueries; ++i)
+        queries.push_back(keys[rng() % keys.size()]);
+    return queries;
+}
+
+template<class Map, class KeyType>
+void fill(Map& map, const std::vector<KeyType>& keys) {
+    for (size_t i = 0; i < keys.size(); ++i)
+        map.insert({keys[i], i});
+}
+
+template<class Map, class KeyType>
+void BM_Insert(benchmark::State& state) {
+    auto keys = make_keys<KeyType>(0, state.range(0));
+    for (auto _ : state) {
+        Map map;
+        fill(map, keys);
+        benchmark::DoNotOptimize(map);
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+template<class Map, class KeyType>
+void BM_FindHit(benchmark::State& state) {
+    auto keys = make_keys<KeyType>(0, state.range(0));
+    Map map;
+    fill(map, keys);
+    auto queries = uniform_queries(keys);
+    for (auto _ : state) {
+        for (auto &key : queries)
+            benchmark::DoNotOptimize(map.find(key));
+    }
+    state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+template<class Map, class KeyType>
+void BM_FindMiss(benchmark::State& state) {
+    size_t size = state.range(0);
+    auto keys = make_keys<KeyType>(0, size);
+    Map map;
+    fill(map, keys);
+    auto queries = uniform_queries(make_keys<KeyType>(size, std::min(size, kQueries)));
+    for (auto _ : state) {
+        for (auto &key : queries)
+            benchmark::DoNotOptimize(map.find(key));
+    }
+    state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+// The queries of BM_FindHit through find_batch, which prefetches a group of buckets and nodes before it compares any
+// key; the difference to BM_FindHit is what the prefetching saves.
+template<class Map, class KeyType>
+void BM_FindBatch(benchmark::State& state) {
+    auto keys = make_keys<KeyType>(0, state.range(0));
+    Map map;
+    fill(map, keys);
+    auto queries = uniform_queries(keys);
+    std::vector<typename Map::iterator> found(queries.size());
+    for (auto _ : state) {
+        map.find_batch(queries.begin(), queries.end(), found.begin());
+        benchmark::DoNotOptimize(found.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+template<class Map, class KeyType>
+void BM_FindZipf(benchmark::State& state) {
+    auto keys = make_keys<KeyType>(0, state.range(0));
+    Map map;
+    fill(map, keys);
+    std::vector<KeyType> queries;
+    queries.reserve(kQueries);
+    for (size_t index : zipf_indices(keys.size(), kQueries))
+        queries.push_back(keys[index]);
+    for (auto _ : state) {
+        for (auto &key : queries)
+            benchmark::DoNotOptimize(map.find(key));
+    }
+    state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+// Every iteration erases all the keys; refilling the table is not timed.
+template<class Map, class KeyType>
+void BM_Erase(benchmark::State& state) {
+    auto keys = make_keys<KeyType>(0, state.range(0));
+    Map map;
+    fill(map, keys);
+    for (auto _ : state) {
+        for (auto &key : keys)
+            map.erase(key);
+        state.PauseTiming();
+        fill(map, keys);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// operator[] on a mix of present and new keys, half of each; new keys are erased again untimed.
+template<class Map, class KeyType>
+void BM_Subscript(benchmark::State& state) {
+    size_t size = state.range(0);
+    auto keys = make_keys<KeyType>(0, size);
+    Map map;
+    fill(map, keys);
+    auto hits = uniform_queries(keys);
+    auto misses = make_keys<KeyType>(size, hits.size());
+    std::vector<KeyType> queries;
+    queries.reserve(hits.size() * 2);
+    for (size_t i = 0; i < hits.size(); ++i) {
+        queries.push_back(hits[i]);
+        queries.push_back(misses[i]);
+    }
+    for (auto _ : state) {
+        for (auto &key : queries)
+            ++map[key];
+        state.PauseTiming();
+        for (auto &key : misses)
+            map.erase(key);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+// clear() of a full table; refilling it is not timed. On a PoolAllocator arena of its own, a map of integer keys
+// releases the arena instead of destroying the elements one by one.
+template<class Map, class KeyType>
+void BM_Clear(benchmark::State& state) {
+    auto keys = make_keys<KeyType>(0, state.range(0));
+    Map map;
+    for (auto _ : state) {
+        state.PauseTiming();
+        fill(map, keys);
+        state.ResumeTiming();
+        map.clear();
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+template<class Map, class KeyType>
+void BM_Iterate(benchmark::State& state) {
+    auto keys = make_keys<KeyType>(0, state.range(0));
+    Map map;
+    fill(map, keys);
+    for (auto _ : state) {
+        size_t sum = 0;
+        for (auto &el : map)
+            sum += el.second;
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// One full rehash into twice as many buckets, the work try_to_rehash() does when the table grows.
+template<class Map, class KeyType>
+void BM_Rehash(benchmark::State& state) {
+    auto keys = make_keys<KeyType>(0, state.range(0));
+    Map map;
+    fill(map, keys);
+    size_t buckets = map.bucket_count();
+    for (auto _ : state) {
+        map.rehash(buckets * 2);
+        state.PauseTiming();
+        map.rehash(buckets);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+template<class KeyType>
+using StdMap = std::unordered_map<KeyType, size_t>;
+template<class KeyType>
+using ChainedMap = HashMap<KeyType, size_t>;
+template<class KeyType>
+using PooledMap = HashMap<KeyType, size_t, std::hash<KeyType>, std::equal_to<KeyType>,
+                          PoolAllocator<std::pair<const KeyType, size_t>>>;
+template<class KeyType>
+using LinearMap = FlatHashMap<KeyType, size_t>;
+template<class KeyType>
+using RobinHoodMap = FlatHashMap<KeyType, size_t, std::hash<KeyType>, RobinHoodProbing>;
+template<class KeyType>
+using SwissMap = SwissHashMap<KeyType, size_t>;
+
+void sizes(benchmark::internal::Benchmark* benchmark) {
+    benchmark->RangeMultiplier(16)->Range(1 << 10, 1 << 22)->Unit(benchmark::kMicrosecond);
+}
+
+}  // namespace
+
+#define HASH_MAP_BENCHMARK_KEY(name, Map, Key) \
+    BENCHMARK_TEMPLATE(name, Map<Key>, Key)->Apply(sizes);
+
+#define HASH_MAP_BENCHMARK(name, Map) \
+    HASH_MAP_BENCHMARK_KEY(name, Map, uint64_t) \
+    HASH_MAP_BENCHMARK_KEY(name, Map, std::string)
+
+#define HASH_MAP_BENCHMARK_ALL_MAPS(name) \
+    HASH_MAP_BENCHMARK(name, StdMap) \
+    HASH_MAP_BENCHMARK(name, ChainedMap) \
+    HASH_MAP_BENCHMARK(name, LinearMap) \
+    HASH_MAP_BENCHMARK(name, RobinHoodMap) \
+    HASH_MAP_BENCHMARK(name, SwissMap)
+
+HASH_MAP_BENCHMARK_ALL_MAPS(BM_Insert)
+HASH_MAP_BENCHMARK_ALL_MAPS(BM_FindHit)
+HASH_MAP_BENCHMARK_ALL_MAPS(BM_FindMiss)
+HASH_MAP_BENCHMARK_ALL_MAPS(BM_FindZipf)
+HASH_MAP_BENCHMARK_ALL_MAPS(BM_Erase)
+HASH_MAP_BENCHMARK_ALL_MAPS(BM_Subscript)
+HASH_MAP_BENCHMARK_ALL_MAPS(BM_Iterate)
+
+// Only HashMap has batch lookups; compare with BM_FindHit of ChainedMap.
+HASH_MAP_BENCHMARK(BM_FindBatch, ChainedMap)
+
+// Refilling takes far longer than clear(), so the number of iterations is fixed.
+BENCHMARK_TEMPLATE(BM_Clear, ChainedMap<uint64_t>, uint64_t)->Apply(sizes)->Iterations(20);
+BENCHMARK_TEMPLATE(BM_Clear, PooledMap<uint64_t>, uint64_t)->Apply(sizes)->Iterations(20);
+BENCHMARK_TEMPLATE(BM_Clear, PooledMap<std::string>, std::string)->Apply(sizes)->Iterations(20);
+
+// Only the chained tables can be rehashed on request.
+HASH_MAP_BENCHMARK(BM_Rehash, StdMap)
+HASH_MAP_BENCHMARK(BM_Rehash, ChainedMap)
+
+BENCHMARK_MAIN();
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+/**
+ * Policies that turn a hash into a bucket index, to be used as the BucketPolicy of HashMap.
+ * A policy decides which bucket counts are allowed, through round_capacity(), and maps hashes onto the buckets
+ * once it is told the actual count with reset().
+ * PowerOfTwoBucketPolicy keeps the count a power of two, so the index is taken with a mask instead of a division.
+ * A mask uses only the lower bits, so the hash is first passed through the MurmurHash3 finalizer; otherwise an
+ * identity hash such as std::hash<int> would put all multiples of the bucket count into one bucket.
+ * PrimeBucketPolicy keeps the count a prime and takes the remainder, which uses every bit of the hash and does not
+ * depend on the quality of the hasher. The division is by a constant chosen from a table, which compilers replace
+ * with a multiplication.
+ */
+
+constexpr uint64_t mix_hash(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+class PowerOfTwoBucketPolicy {
+public:
+    static size_t round_capacity(size_t capacity) {
+        size_t power = 1;
+        while (power < capacity) {
+            if (power > SIZE_MAX / 2)
+                throw std::length_error("hash table is too large");
+            power <<= 1;
+        }
+        return power;
+    }
+
+    void reset(size_t capacity) {
+        mask_ = capacity - 1;
+    }
+
+    size_t index(size_t hash) const {
+        return static_cast<size_t>(mix_hash(hash)) & mask_;
+    }
+
+private:
+    size_t mask_ = 0;
+};
+
+namespace bucket_policy_detail {
+
+// The first prime above every power of two from 2^4 up to 2^63.
+constexpr uint64_t kPrimes[] = {
+    17ull, 37ull, 67ull, 131ull, 257ull, 521ull, 1031ull, 2053ull, 4099ull, 8209ull, 16411ull, 32771ull, 65537ull,
+    131101ull, 262147ull, 524309ull, 1048583ull, 2097169ull, 4194319ull, 8388617ull, 16777259ull, 33554467ull,
+    67108879ull, 134217757ull, 268435459ull, 536870923ull, 1073741827ull, 2147483659ull, 4294967311ull,
+    8589934609ull, 17179869209ull, 34359738421ull, 68719476767ull, 137438953481ull, 274877906951ull,
+    549755813911ull, 1099511627791ull, 2199023255579ull, 4398046511119ull, 8796093022237ull, 17592186044423ull,
+    35184372088891ull, 70368744177679ull, 140737488355333ull, 281474976710677ull, 562949953421381ull,
+    1125899906842679ull, 2251799813685269ull, 4503599627370517ull, 9007199254740997ull, 18014398509482143ull,
+    36028797018963971ull, 72057594037928017ull, 144115188075855881ull, 288230376151711813ull,
+    576460752303423619ull, 1152921504606847009ull, 2305843009213693967ull, 4611686018427388039ull,
+    9223372036854775837ull};
+
+constexpr size_t kNumPrimes = sizeof(kPrimes) / sizeof(kPrimes[0]);
+
+template<size_t I>
+size_t mod_prime(size_t hash) {
+    return static_cast<size_t>(static_cast<uint64_t>(hash) % kPrimes[I]);
+}
+
+using ModFunction = size_t (*)(size_t);
+
+template<class Indices>
+struct ModTable;
+
+template<size_t... I>
+struct ModTable<std::index_sequence<I...>> {
+    static constexpr ModFunction kFunctions[] = {&mod_prime<I>...};
+};
+
+}  // namespace bucket_policy_detail
+
+class PrimeBucketPolicy {
+    using ModTable = bucket_policy_detail::ModTable<std::make_index_sequence<bucket_policy_detail::kNumPrimes>>;
+
+public:
+    static size_t round_capacity(size_t capacity) {
+        return bucket_policy_detail::kPrimes[prime_index(capacity)];
+    }
+
+    void reset(size_t capacity) {
+        mod_ = ModTable::kFunctions[prime_index(capacity)];
+    }
+
+    size_t index(size_t hash) const {
+        return mod_(hash);
+    }
+
+private:
+    static size_t prime_index(size_t capacity) {
+        for (size_t i = 0; i < bucket_policy_detail::kNumPrimes; ++i) {
+            if (bucket_policy_detail::kPrimes[i] >= capacity)
+                return i;
+        }
+        throw std::length_error("hash table is too large");
+    }
+
+    bucket_policy_detail::ModFunction mod_ = &bucket_policy_detail::mod_prime<0>;
+};
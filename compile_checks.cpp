@@ -0,0 +1,49 @@
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "hash_map.h"
+#include "hash_multimap.h"
+#include "hash_set.h"
+#include "pool_allocator.h"
+
+/**
+ * Instantiates the members of the containers that the benchmarks do not use, so that every build at least compiles
+ * them. Nothing here is meant to be called.
+ */
+
+namespace {
+
+template<class Map>
+void move_around(Map& first, Map& second) {
+    Map moved(std::move(first));
+    second = std::move(moved);
+    first = second;
+    first.swap(second);
+}
+
+// std::vector moves its elements on reallocation only if that cannot throw.
+static_assert(std::is_nothrow_move_constructible<HashMap<std::string, int>>::value, "HashMap move may throw");
+static_assert(std::is_nothrow_move_assignable<HashMap<std::string, int>>::value, "HashMap move may throw");
+static_assert(std::is_nothrow_move_constructible<HashSet<int>>::value, "HashSet move may throw");
+static_assert(std::is_nothrow_move_constructible<HashMultiMap<int, int>>::value, "HashMultiMap move may throw");
+
+}  // namespace
+
+void compile_checks() {
+    HashSet<int> int_sets[2];
+    move_around(int_sets[0], int_sets[1]);
+    HashSet<std::string, StringHash, std::equal_to<>> string_sets[2];
+    move_around(string_sets[0], string_sets[1]);
+    HashSet<int, std::hash<int>, std::equal_to<int>, PoolAllocator<int>> pooled_sets[2];
+    move_around(pooled_sets[0], pooled_sets[1]);
+
+    HashMultiMap<int, std::string> multimaps[2];
+    move_around(multimaps[0], multimaps[1]);
+    HashMultiMap<std::string, int, std::hash<std::string>, std::equal_to<std::string>,
+                 PoolAllocator<std::pair<const std::string, int>>> pooled_multimaps[2];
+    move_around(pooled_multimaps[0], pooled_multimaps[1]);
+
+    HashMap<int, int> maps[2];
+    move_around(maps[0], maps[1]);
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "bucket_policy.h"
+#include "hash_map.h"
+
+/**
+ * Thread-safe map made of independent HashMap shards, each guarded by its own reader-writer lock.
+ * A key goes to the shard chosen by the upper bits of its mixed hash, while HashMap picks the bucket from the
+ * lower ones, so the keys of one shard still spread over all the buckets. Lookups take the lock of their shard
+ * in shared mode, so readers run in parallel, and writers only block operations on the same shard.
+ * No iterators or references leave a shard: find returns a copy of the value, visit calls a function on the value
+ * while the shard is locked, and upsert updates the value in place atomically.
+ * Every shard gets its own allocator through select_on_container_copy_construction, so shards built on PoolAllocator
+ * do not share an arena. The allocators may also be made per shard, so that each shard lives on its own NUMA node.
+ */
+
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class KeyEqual = std::equal_to<KeyType>,
+         class Allocator = std::allocator<std::pair<const KeyType, ValueType>> >
+class ConcurrentHashMap {
+public:
+    using shard_type = HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator>;
+
+private:
+    // Shards are aligned to a cache line, so that the locks of neighbours do not share one.
+    struct alignas(64) Shard {
+        Shard(const Hash& hasher, const KeyEqual& equal, const Allocator& alloc) : map(hasher, equal, alloc) {}
+
+        mutable std::shared_mutex mutex;
+        shard_type map;
+    };
+
+    Hash hasher_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    // The shard index is the upper bits of the mixed hash; a single shard takes no bits at all.
+    unsigned shift_;
+
+    static constexpr unsigned kHashBits = sizeof(size_t) * 8;
+
+    static size_t default_shard_count() {
+        size_t threads = std::thread::hardware_concurrency();
+        return threads * 4 < 16 ? 16 : threads * 4;
+    }
+
+    template<class K>
+    Shard& shard_for(const K& key) const {
+        if (shift_ == kHashBits)
+            return *shards_[0];
+        return *shards_[static_cast<size_t>(mix_hash(hasher_(key))) >> shift_];
+    }
+
+public:
+    explicit ConcurrentHashMap(size_t num_shards = default_shard_count(), Hash hasher_obj = Hash(),
+                               const KeyEqual& equal = KeyEqual(), const Allocator& alloc = Allocator())
+        : ConcurrentHashMap(num_shards, [&alloc](size_t) {
+              return std::allocator_traits<Allocator>::select_on_container_copy_construction(alloc);
+          }, hasher_obj, equal) {}
+
+    // Shard i gets the allocator make_allocator(i), e.g. a PoolAllocator whose pages are bound to the NUMA node of
+    // the threads that work on that shard.
+    template<class MakeAllocator, class = typename std::enable_if<
+        std::is_convertible<std::invoke_result_t<MakeAllocator&, size_t>, Allocator>::value>::type>
+    ConcurrentHashMap(size_t num_shards, MakeAllocator make_allocator, Hash hasher_obj = Hash(),
+                      const KeyEqual& equal = KeyEqual())
+        : hasher_(hasher_obj) {
+        num_shards = PowerOfTwoBucketPolicy::round_capacity(num_shards);
+        shift_ = kHashBits;
+        for (size_t power = 1; power < num_shards; power <<= 1)
+            --shift_;
+        shards_.reserve(num_shards);
+        for (size_t i = 0; i < num_shards; ++i)
+            shards_.push_back(std::make_unique<Shard>(hasher_obj, equal, make_allocator(i)));
+    }
+
+    ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+    ConcurrentHashMap& operator= (const ConcurrentHashMap&) = delete;
+
+    // Returns true if the element was inserted, false if the key was already there.
+    bool insert(const std::pair<const KeyType, ValueType>& obj) {
+        Shard& shard = shard_for(obj.first);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto old_size = shard.map.size();
+        shard.map.insert(obj);
+        return shard.map.size() != old_size;
+    }
+
+    bool insert(std::pair<const KeyType, ValueType>&& obj) {
+        Shard& shard = shard_for(obj.first);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto old_size = shard.map.size();
+        shard.map.insert(std::move(obj));
+        return shard.map.size() != old_size;
+    }
+
+    template<class K, class... Args>
+    bool try_emplace(K&& key, Args&&... args) {
+        Shard& shard = shard_for(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.map.try_emplace(std::forward<K>(key), std::forward<Args>(args)...).second;
+    }
+
+    template<class K, class M>
+    bool insert_or_assign(K&& key, M&& obj) {
+        Shard& shard = shard_for(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.map.insert_or_assign(std::forward<K>(key), std::forward<M>(obj)).second;
+    }
+
+    // Atomically calls fn(ValueType&) on the value of the key, which is value-initialized first if the key is new.
+    // Returns true if the key was inserted.
+    template<class K, class F>
+    bool upsert(K&& key, F&& fn) {
+        Shard& shard = shard_for(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto result = shard.map.try_emplace(std::forward<K>(key));
+        std::forward<F>(fn)(result.first->second);
+        return result.second;
+    }
+
+    // Returns true if the key was erased.
+    template<class K>
+    bool erase(const K& key) {
+        Shard& shard = shard_for(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto old_size = shard.map.size();
+        shard.map.erase(key);
+        return shard.map.size() != old_size;
+    }
+
+    template<class K>
+    std::optional<ValueType> find(const K& key) const {
+        const Shard& shard = shard_for(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto iter = shard.map.find(key);
+        if (iter == shard.map.end())
+            return std::nullopt;
+        return iter->second;
+    }
+
+    // Calls fn(const ValueType&) under the shard lock if the key is present, which avoids copying the value.
+    template<class K, class F>
+    bool visit(const K& key, F&& fn) const {
+        const Shard& shard = shard_for(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto iter = shard.map.find(key);
+        if (iter == shard.map.end())
+            return false;
+        std::forward<F>(fn)(iter->second);
+        return true;
+    }
+
+    template<class K>
+    bool contains(const K& key) const {
+        const Shard& shard = shard_for(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.map.find(key) != shard.map.end();
+    }
+
+    // Calls fn(const std::pair<const KeyType, ValueType>&) for every element, locking one shard at a time.
+    template<class F>
+    void for_each(F&& fn) const {
+        for (auto &shard : shards_) {
+            std::shared_lock<std::shared_mutex> lock(shard->mutex);
+            for (auto &el : shard->map)
+                fn(el);
+        }
+    }
+
+    // Locks one shard at a time, so under concurrent updates the result is only a snapshot of each shard.
+    size_t size() const {
+        size_t result = 0;
+        for (auto &shard : shards_) {
+            std::shared_lock<std::shared_mutex> lock(shard->mutex);
+            result += shard->map.size();
+        }
+        return result;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    void clear() {
+        for (auto &shard : shards_) {
+            std::unique_lock<std::shared_mutex> lock(shard->mutex);
+            shard->map.clear();
+        }
+    }
+
+    // Prepares every shard for its share of 'count' elements.
+    void reserve(size_t count) {
+        for (auto &shard : shards_) {
+            std::unique_lock<std::shared_mutex> lock(shard->mutex);
+            shard->map.reserve(count / shards_.size() + 1);
+        }
+    }
+
+    size_t shard_count() const {
+        return shards_.size();
+    }
+
+    Hash hash_function() const {
+        return hasher_;
+    }
+};
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "bucket_policy.h"
+
+/**
+ * Chained hash map that keeps all the 'key, value' pairs contiguous, in one vector, so that a full scan reads memory
+ * sequentially. The chains are kept apart from the elements: every bucket holds the index of its first element,
+ * and a second vector, parallel to the elements, holds the cached hash and the index of the next element in the
+ * chain. Rehashing only rebuilds these indices, the elements themselves never move when the table grows.
+ * Erasure moves the last element into the hole and pops the vector, fixing the one index that pointed to the moved
+ * element, so the elements stay contiguous; iteration order is the insertion order up to these moves.
+ * Iterator rules differ from HashMap: insert may invalidate all iterators, like push_back on a vector, and erase
+ * invalidates iterators to the erased and to the last element. Keys are reachable through iterators as non-const
+ * members, since swap-and-pop has to assign them, but they must not be modified.
+ */
+
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class KeyEqual = std::equal_to<KeyType> >
+class DenseHashMap {
+public:
+    using value_type = std::pair<KeyType, ValueType>;
+    using iterator = typename std::vector<value_type>::iterator;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+
+private:
+    static constexpr size_t kNone = SIZE_MAX;
+    static constexpr size_t kInitialCapacity = 16;
+    static constexpr size_t kGrowthFactor = 2;
+
+    struct Link {
+        size_t hash;
+        size_t next;
+    };
+
+    Hash hasher_;
+    KeyEqual key_equal_;
+    std::vector<value_type> entries_;
+    std::vector<Link> links_;
+    std::vector<size_t> buckets_;
+    PowerOfTwoBucketPolicy policy_;
+
+    // Rebuilds the chains for 'capacity' buckets; the elements stay where they are. The new bucket array is allocated
+    // before anything is changed, so a failed allocation leaves the old chains as they were.
+    void InitializeTable(size_t capacity = kInitialCapacity) {
+        capacity = PowerOfTwoBucketPolicy::round_capacity(capacity);
+        std::vector<size_t> buckets(capacity, kNone);
+        buckets_.swap(buckets);
+        policy_.reset(capacity);
+        for (size_t i = 0; i < entries_.size(); ++i) {
+            size_t& head = buckets_[policy_.index(links_[i].hash)];
+            links_[i].next = head;
+            head = i;
+        }
+    }
+
+    // Returns the index that points to the element with the key, or to kNone at the end of the chain.
+    size_t* find_link(const KeyType& key, size_t hash) {
+        size_t* link = &buckets_[policy_.index(hash)];
+        while (*link != kNone && !(links_[*link].hash == hash && key_equal_(entries_[*link].first, key)))
+            link = &links_[*link].next;
+        return link;
+    }
+
+    size_t find_index(const KeyType& key) const {
+        size_t hash = hasher_(key);
+        for (size_t index = buckets_[policy_.index(hash)]; index != kNone; index = links_[index].next) {
+            if (links_[index].hash == hash && key_equal_(entries_[index].first, key))
+                return index;
+        }
+        return entries_.size();
+    }
+
+    // Links the element that has just been pushed to the back of entries_. If that throws, the element is popped
+    // again, so that no element is left outside of the chains.
+    void add_to_table(size_t hash) {
+        try {
+            links_.push_back({hash, kNone});
+        } catch (...) {
+            entries_.pop_back();
+            throw;
+        }
+        if (entries_.size() > buckets_.size()) {
+            try {
+                InitializeTable(buckets_.size() * kGrowthFactor);
+            } catch (...) {
+                entries_.pop_back();
+                links_.pop_back();
+                throw;
+            }
+            return;
+        }
+        size_t& head = buckets_[policy_.index(hash)];
+        links_.back().next = head;
+        head = entries_.size() - 1;
+    }
+
+    template<class K, class... Args>
+    std::pair<iterator, bool> try_emplace_key(K&& key, Args&&... args) {
+        size_t hash = hasher_(key);
+        size_t* link = find_link(key, hash);
+        if (*link != kNone)
+            return {entries_.begin() + *link, false};
+
+        entries_.emplace_back(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                              std::forward_as_tuple(std::forward<Args>(args)...));
+        add_to_table(hash);
+        return {entries_.end() - 1, true};
+    }
+
+public:
+    explicit DenseHashMap(Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual())
+        : hasher_(hasher_obj), key_equal_(equal) {
+        InitializeTable();
+    }
+
+    // Constructors are implemented as a bunch of insertions.
+    template<typename _ForwardIterator>
+    DenseHashMap(_ForwardIterator begin, _ForwardIterator end, Hash hasher_obj = Hash(),
+                 const KeyEqual& equal = KeyEqual()) : DenseHashMap(hasher_obj, equal) {
+        for (auto it = begin; it != end; ++it) {
+            insert(*it);
+        }
+    }
+
+    DenseHashMap(std::initializer_list<value_type> list, Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual())
+        : DenseHashMap(list.begin(), list.end(), hasher_obj, equal) {}
+
+    DenseHashMap(const DenseHashMap& other) = default;
+
+    // The source is left empty but usable.
+    DenseHashMap(DenseHashMap&& other) : DenseHashMap(other.hasher_, other.key_equal_) {
+        swap(other);
+    }
+
+    DenseHashMap& operator= (const DenseHashMap& other) = default;
+
+    DenseHashMap& operator= (DenseHashMap&& other) {
+        if (this == &other)
+            return *this;
+
+        swap(other);
+        other.clear();
+        return *this;
+    }
+
+    // Check if table contains the key and do nothing if it does, or add it.
+    iterator insert(const value_type& obj) {
+        return try_emplace_key(obj.first, obj.second).first;
+    }
+
+    iterator insert(value_type&& obj) {
+        return try_emplace_key(std::move(obj.first), std::move(obj.second)).first;
+    }
+
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(const KeyType& key, Args&&... args) {
+        return try_emplace_key(key, std::forward<Args>(args)...);
+    }
+
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(KeyType&& key, Args&&... args) {
+        return try_emplace_key(std::move(key), std::forward<Args>(args)...);
+    }
+
+    template<class M>
+    std::pair<iterator, bool> insert_or_assign(const KeyType& key, M&& obj) {
+        auto result = try_emplace_key(key, std::forward<M>(obj));
+        if (!result.second)
+            result.first->second = std::forward<M>(obj);
+        return result;
+    }
+
+    // Swap-and-pop: the last element takes the place of the erased one. The element is moved before any link
+    // changes, value first, so a throwing move of the value leaves the map as it was.
+    void erase(const KeyType& to_delete) {
+        size_t* link = find_link(to_delete, hasher_(to_delete));
+        size_t index = *link;
+        if (index == kNone)
+            return;
+
+        size_t last = entries_.size() - 1;
+        if (index != last) {
+            entries_[index].second = std::move(entries_[last].second);
+            entries_[index].first = std::move(entries_[last].first);
+            *link = links_[index].next;
+            size_t* last_link = &buckets_[policy_.index(links_[last].hash)];
+            while (*last_link != last)
+                last_link = &links_[*last_link].next;
+            *last_link = index;
+            links_[index] = links_[last];
+        } else {
+            *link = links_[index].next;
+        }
+        entries_.pop_back();
+        links_.pop_back();
+    }
+
+    iterator find(const KeyType& key) {
+        return entries_.begin() + find_index(key);
+    }
+
+    const_iterator find(const KeyType& key) const {
+        return entries_.begin() + find_index(key);
+    }
+
+    ValueType& operator[](const KeyType& key) {
+        return try_emplace_key(key).first->second;
+    }
+
+    const ValueType& at(const KeyType& key) const {
+        const_iterator iter = find(key);
+        if (iter == end())
+            throw std::out_of_range("no such element");
+        return iter->second;
+    }
+
+    void clear() {
+        entries_.clear();
+        links_.clear();
+        InitializeTable();
+    }
+
+    // Prepares the table for 'count' elements, so that inserting them moves neither elements nor chains.
+    void reserve(size_t count) {
+        entries_.reserve(count);
+        links_.reserve(count);
+        if (count > buckets_.size())
+            InitializeTable(count);
+    }
+
+    void swap(DenseHashMap& other) noexcept {
+        std::swap(hasher_, other.hasher_);
+        std::swap(key_equal_, other.key_equal_);
+        entries_.swap(other.entries_);
+        links_.swap(other.links_);
+        buckets_.swap(other.buckets_);
+        std::swap(policy_, other.policy_);
+    }
+
+    Hash hash_function() const {
+        return hasher_;
+    }
+
+    KeyEqual key_eq() const {
+        return key_equal_;
+    }
+
+    size_t bucket_count() const {
+        return buckets_.size();
+    }
+
+    size_t size() const {
+        return entries_.size();
+    }
+
+    bool empty() const {
+        return entries_.empty();
+    }
+
+    iterator begin() {
+        return entries_.begin();
+    }
+    iterator end() {
+        return entries_.end();
+    }
+    const_iterator begin() const {
+        return entries_.begin();
+    }
+    const_iterator end() const {
+        return entries_.end();
+    }
+};
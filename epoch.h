@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * Epoch-based reclamation of memory that lock-free readers may still be looking at.
+ * A reader pins the current global epoch into a slot of its own for as long as it holds an EpochGuard. A writer that
+ * unlinks an object hands it to retire(), which stamps it with the global epoch and then advances that epoch. Readers
+ * that pinned a later epoch started after the object was unlinked and cannot reach it, so the object is freed as soon
+ * as every pinned epoch is newer than its stamp.
+ * Each thread takes a free slot on its first EpochGuard and gives it back when it exits; there are kMaxThreads slots.
+ * retire() may be called concurrently; readers never wait for anything.
+ */
+
+class EpochDomain {
+public:
+    static constexpr size_t kMaxThreads = 256;
+
+    static EpochDomain& instance() {
+        static EpochDomain domain;
+        return domain;
+    }
+
+    // Pins the current epoch for the calling thread. Guards may nest.
+    void enter() {
+        ThreadSlot& slot = this_thread_slot();
+        if (slot.depth++ == 0) {
+            slot.slot->epoch.store(global_epoch_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            // Pairs with the fence in retire(): either the writer saw this pin, or this reader sees the unlink.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    void leave() {
+        ThreadSlot& slot = this_thread_slot();
+        if (--slot.depth == 0)
+            slot.slot->epoch.store(kIdle, std::memory_order_release);
+    }
+
+    // Frees the object with 'deleter' once no reader may reach it anymore. The object must already be unlinked.
+    void retire(void* object, void (*deleter)(void*)) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::vector<Retired> ready;
+        {
+            std::lock_guard<std::mutex> lock(retired_mutex_);
+            retired_.push_back({object, deleter, global_epoch_.fetch_add(1, std::memory_order_acq_rel)});
+            if (retired_.size() >= kReclaimThreshold)
+                collect(ready);
+        }
+        for (auto &item : ready)
+            item.deleter(item.object);
+    }
+
+    template<class T>
+    void retire(T* object) {
+        retire(object, [](void* p) { delete static_cast<T*>(p); });
+    }
+
+    // Frees everything that no reader may reach anymore.
+    void reclaim() {
+        std::vector<Retired> ready;
+        {
+            std::lock_guard<std::mutex> lock(retired_mutex_);
+            collect(ready);
+        }
+        for (auto &item : ready)
+            item.deleter(item.object);
+    }
+
+    ~EpochDomain() {
+        for (auto &item : retired_)
+            item.deleter(item.object);
+    }
+
+private:
+    static constexpr uint64_t kIdle = UINT64_MAX;
+    static constexpr size_t kReclaimThreshold = 64;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{kIdle};
+        std::atomic<bool> taken{false};
+    };
+
+    struct ThreadSlot {
+        Slot* slot = nullptr;
+        uint32_t depth = 0;
+
+        ~ThreadSlot() {
+            if (slot != nullptr)
+                slot->taken.store(false, std::memory_order_release);
+        }
+    };
+
+    struct Retired {
+        void* object;
+        void (*deleter)(void*);
+        uint64_t epoch;
+    };
+
+    EpochDomain() = default;
+
+    ThreadSlot& this_thread_slot() {
+        thread_local ThreadSlot thread_slot;
+        if (thread_slot.slot == nullptr) {
+            for (auto &slot : slots_) {
+                bool expected = false;
+                if (!slot.taken.load(std::memory_order_relaxed) &&
+                    slot.taken.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                    thread_slot.slot = &slot;
+                    break;
+                }
+            }
+            if (thread_slot.slot == nullptr)
+                throw std::runtime_error("too many threads in the epoch domain");
+        }
+        return thread_slot;
+    }
+
+    // Moves the objects that are older than every pinned epoch to 'ready'. Expects retired_mutex_ to be held.
+    void collect(std::vector<Retired>& ready) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t oldest = kIdle;
+        for (auto &slot : slots_) {
+            uint64_t epoch = slot.epoch.load(std::memory_order_acquire);
+            if (epoch < oldest)
+                oldest = epoch;
+        }
+        size_t kept = 0;
+        for (auto &item : retired_) {
+            if (item.epoch < oldest)
+                ready.push_back(item);
+            else
+                retired_[kept++] = item;
+        }
+        retired_.resize(kept);
+    }
+
+    std::atomic<uint64_t> global_epoch_{0};
+    Slot slots_[kMaxThreads];
+    std::mutex retired_mutex_;
+    std::vector<Retired> retired_;
+};
+
+// Keeps everything the current thread reads from being freed while the guard lives.
+class EpochGuard {
+public:
+    EpochGuard() {
+        EpochDomain::instance().enter();
+    }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator= (const EpochGuard&) = delete;
+
+    ~EpochGuard() {
+        EpochDomain::instance().leave();
+    }
+};
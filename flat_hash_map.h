@@ -0,0 +1,446 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Open addressing counterpart of HashMap with the same insert/find/erase/operator[]/at interface.
+ * All the 'key, value' pairs live in one flat array of slots, and every slot keeps the distance from the
+ * element's home slot next to the element itself. So a lookup walks consecutive memory instead of chasing
+ * list nodes, and an insertion does no allocation unless the table grows.
+ * The probing scheme is selected by the Probing parameter. LinearProbing takes the first free slot, while
+ * RobinHoodProbing lets a new element take the place of one that is closer to its home slot; that keeps
+ * probe sequences short and lets unsuccessful lookups stop early. Erasure shifts the following elements
+ * back instead of leaving tombstones. Note that, unlike HashMap, insert and erase invalidate iterators.
+ */
+
+struct LinearProbing {
+    static constexpr bool kRobinHood = false;
+    static constexpr size_t kMaxLoadPercent = 70;
+};
+
+struct RobinHoodProbing {
+    static constexpr bool kRobinHood = true;
+    static constexpr size_t kMaxLoadPercent = 90;
+};
+
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class Probing = LinearProbing>
+class FlatHashMap {
+public:
+    using value_type = std::pair<const KeyType, ValueType>;
+
+private:
+    struct Slot {
+        // Zero marks an empty slot, otherwise it is the distance from the home slot plus one.
+        uint32_t distance;
+        alignas(value_type) unsigned char storage[sizeof(value_type)];
+
+        value_type* value() {
+            return std::launder(reinterpret_cast<value_type*>(storage));
+        }
+        const value_type* value() const {
+            return std::launder(reinterpret_cast<const value_type*>(storage));
+        }
+    };
+
+    template<bool IsConst>
+    class Iterator {
+        using SlotPointer = typename std::conditional<IsConst, const Slot*, Slot*>::type;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename FlatHashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = typename std::conditional<IsConst, const value_type*, value_type*>::type;
+        using reference = typename std::conditional<IsConst, const value_type&, value_type&>::type;
+
+        Iterator() = default;
+
+        // Every iterator may be turned into a const_iterator.
+        template<bool OtherConst, class = typename std::enable_if<IsConst && !OtherConst>::type>
+        Iterator(const Iterator<OtherConst>& other) : slot_(other.slot_), end_(other.end_) {}
+
+        reference operator*() const {
+            return *slot_->value();
+        }
+        pointer operator->() const {
+            return slot_->value();
+        }
+
+        Iterator& operator++() {
+            ++slot_;
+            skip_empty();
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return slot_ == other.slot_;
+        }
+        bool operator!=(const Iterator& other) const {
+            return slot_ != other.slot_;
+        }
+
+    private:
+        friend class FlatHashMap;
+        template<bool> friend class Iterator;
+
+        Iterator(SlotPointer slot, SlotPointer end) : slot_(slot), end_(end) {
+            skip_empty();
+        }
+
+        void skip_empty() {
+            while (slot_ != end_ && slot_->distance == 0)
+                ++slot_;
+        }
+
+        SlotPointer slot_ = nullptr;
+        SlotPointer end_ = nullptr;
+    };
+
+public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+private:
+    static constexpr size_t kInitialCapacity = 16;
+
+    Hash hasher_;
+    Slot* slots_ = nullptr;
+    // Capacity is always a power of two, so that the home slot is taken from the upper bits of the hash.
+    size_t capacity_ = 0;
+    int32_t shift_ = 0;
+    size_t num_elements_ = 0;
+
+    // Fibonacci hashing: the multiplication spreads weak hashes such as the identity over all the bits.
+    size_t HomeSlot(const KeyType& obj) const {
+        return static_cast<size_t>((static_cast<uint64_t>(hasher_(obj)) * 0x9E3779B97F4A7C15ull) >> shift_);
+    }
+
+    size_t next_slot(size_t index) const {
+        return (index + 1) & (capacity_ - 1);
+    }
+
+    // Owns a slot array that is not installed into the map, together with the capacity and shift that go with it. The
+    // array is allocated by the constructor, so a failed allocation leaves nothing behind, and the elements still in
+    // it are destroyed together with it.
+    struct TableMemory {
+        explicit TableMemory(size_t count) : capacity(count) {
+            for (size_t power = 1; power < capacity; power <<= 1)
+                --shift;
+            slots = std::allocator<Slot>().allocate(capacity);
+            for (size_t i = 0; i < capacity; ++i)
+                slots[i].distance = 0;
+        }
+
+        TableMemory(const TableMemory&) = delete;
+        TableMemory& operator= (const TableMemory&) = delete;
+
+        ~TableMemory() {
+            if (slots == nullptr)
+                return;
+            for (size_t i = 0; i < capacity; ++i) {
+                if (slots[i].distance != 0)
+                    slots[i].value()->~value_type();
+            }
+            std::allocator<Slot>().deallocate(slots, capacity);
+        }
+
+        Slot* slots = nullptr;
+        size_t capacity;
+        int32_t shift = 64;
+    };
+
+    // Installs the array of 'memory' into the map and hands the previous one over to 'memory'.
+    void exchange(TableMemory& memory) noexcept {
+        std::swap(slots_, memory.slots);
+        std::swap(capacity_, memory.capacity);
+        std::swap(shift_, memory.shift);
+    }
+
+    void InitializeTable(const size_t capacity = kInitialCapacity) {
+        TableMemory memory(capacity);
+        exchange(memory);
+    }
+
+    void destroy_table() {
+        if (slots_ == nullptr)
+            return;
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (slots_[i].distance != 0)
+                slots_[i].value()->~value_type();
+        }
+        std::allocator<Slot>().deallocate(slots_, capacity_);
+        slots_ = nullptr;
+        num_elements_ = 0;
+    }
+
+    // Returns the slot holding the key, or capacity_ if there is no such slot.
+    size_t find_index(const KeyType& key) const {
+        size_t index = HomeSlot(key);
+        for (uint32_t distance = 1;; ++distance) {
+            const Slot& slot = slots_[index];
+            if (slot.distance == 0)
+                return capacity_;
+            // Robin Hood keeps elements of a cluster ordered by home slot, so a closer element means a miss.
+            if (Probing::kRobinHood && slot.distance < distance)
+                return capacity_;
+            if (slot.value()->first == key)
+                return index;
+            index = next_slot(index);
+        }
+    }
+
+    void move_slot(size_t from, size_t to, uint32_t distance) {
+        new (slots_[to].storage) value_type(std::move(*slots_[from].value()));
+        slots_[to].distance = distance;
+        slots_[from].value()->~value_type();
+        slots_[from].distance = 0;
+    }
+
+    // Moves the run of elements starting at index one slot forward, leaving index empty.
+    void shift_run(size_t index) {
+        size_t last = index;
+        while (slots_[last].distance != 0)
+            last = next_slot(last);
+        while (last != index) {
+            size_t prev = (last - 1) & (capacity_ - 1);
+            move_slot(prev, last, slots_[prev].distance + 1);
+            last = prev;
+        }
+    }
+
+    // Fills the empty slot 'hole' by pulling back the following elements that may legally stand there.
+    void close_gap(size_t hole) {
+        size_t index = hole;
+        for (uint32_t gap = 1;; ++gap) {
+            index = next_slot(index);
+            const uint32_t distance = slots_[index].distance;
+            if (distance == 0)
+                return;
+            if (distance > gap) {
+                move_slot(index, hole, distance - gap);
+                hole = index;
+                gap = 0;
+            }
+        }
+    }
+
+    // Finds the slot for a new element, guaranteed not be in the table, and makes sure it is empty.
+    size_t free_slot_for(const KeyType& key, uint32_t* distance) {
+        size_t index = HomeSlot(key);
+        *distance = 1;
+        while (slots_[index].distance != 0 &&
+               (!Probing::kRobinHood || slots_[index].distance >= *distance)) {
+            index = next_slot(index);
+            ++*distance;
+        }
+        if (slots_[index].distance != 0)
+            shift_run(index);
+        return index;
+    }
+
+    // Method that is called when a new element, guaranteed not be in the table, is added.
+    template<class Value>
+    size_t add_to_slots(Value&& obj) {
+        uint32_t distance;
+        size_t index = free_slot_for(obj.first, &distance);
+        try {
+            new (slots_[index].storage) value_type(std::forward<Value>(obj));
+        } catch (...) {
+            close_gap(index);
+            throw;
+        }
+        slots_[index].distance = distance;
+        return index;
+    }
+
+    // Grows the table, so that one more element fits under the maximal load.
+    // The new array is installed and filled while the old one waits aside. Elements are moved only if that cannot
+    // throw, and copied otherwise, so if anything throws, the old array is put back and the map stays as it was.
+    void try_to_rehash() {
+        if ((num_elements_ + 1) * 100 <= capacity_ * Probing::kMaxLoadPercent)
+            return;
+
+        TableMemory table(capacity_ * 2);
+        exchange(table);
+        try {
+            for (size_t i = 0; i < table.capacity; ++i) {
+                if (table.slots[i].distance != 0)
+                    add_to_slots(std::move_if_noexcept(*table.slots[i].value()));
+            }
+        } catch (...) {
+            exchange(table);
+            throw;
+        }
+        // The old elements have been moved or copied from, and go away together with the old array.
+    }
+
+    iterator iterator_at(size_t index) {
+        return iterator(slots_ + index, slots_ + capacity_);
+    }
+    const_iterator iterator_at(size_t index) const {
+        return const_iterator(slots_ + index, slots_ + capacity_);
+    }
+
+public:
+    explicit FlatHashMap(Hash hasher_obj = Hash()) : hasher_(hasher_obj) {
+        InitializeTable();
+    }
+
+    // Constructors are implemented as a bunch of insertions.
+    template<typename _ForwardIterator>
+    FlatHashMap(_ForwardIterator begin, _ForwardIterator end, Hash hasher_obj = Hash()) : FlatHashMap(hasher_obj) {
+        for (auto it = begin; it != end; ++it) {
+            insert(*it);
+        }
+    }
+
+    FlatHashMap(std::initializer_list<std::pair<KeyType, ValueType>> list,
+                Hash hasher_obj = Hash()) : FlatHashMap(list.begin(), list.end(), hasher_obj) {}
+
+    // The copy keeps the slot layout of the source, so no element has to be hashed again.
+    FlatHashMap(const FlatHashMap& other) : hasher_(other.hasher_) {
+        InitializeTable(other.capacity_);
+        try {
+            for (size_t i = 0; i < capacity_; ++i) {
+                if (other.slots_[i].distance == 0)
+                    continue;
+                new (slots_[i].storage) value_type(*other.slots_[i].value());
+                slots_[i].distance = other.slots_[i].distance;
+                ++num_elements_;
+            }
+        } catch (...) {
+            destroy_table();
+            throw;
+        }
+    }
+
+    FlatHashMap(FlatHashMap&& other)
+        : hasher_(std::move(other.hasher_)), slots_(other.slots_), capacity_(other.capacity_),
+          shift_(other.shift_), num_elements_(other.num_elements_) {
+        other.slots_ = nullptr;
+        other.InitializeTable();
+    }
+
+    FlatHashMap& operator= (const FlatHashMap& other) {
+
+        //Anti-self-assignment.
+        if (this == &other)
+            return *this;
+
+        FlatHashMap copy(other);
+        swap(copy);
+        return *this;
+    }
+
+    FlatHashMap& operator= (FlatHashMap&& other) {
+        if (this == &other)
+            return *this;
+
+        swap(other);
+        other.clear();
+        return *this;
+    }
+
+    // Check if table contains the key and do nothing if it does, or add it.
+    iterator insert(std::pair<KeyType, ValueType> obj) {
+        size_t index = find_index(obj.first);
+        if (index != capacity_)
+            return iterator_at(index);
+
+        // The table grows before the element is placed, so that the returned iterator stays valid.
+        try_to_rehash();
+        index = add_to_slots(std::move(obj));
+        ++num_elements_;
+        return iterator_at(index);
+    }
+
+    void erase(const KeyType& to_delete) {
+        size_t index = find_index(to_delete);
+        if (index == capacity_)
+            return;
+
+        slots_[index].value()->~value_type();
+        slots_[index].distance = 0;
+        --num_elements_;
+        close_gap(index);
+    }
+
+    iterator find(const KeyType& key) {
+        return iterator_at(find_index(key));
+    }
+
+    const_iterator find(const KeyType& key) const {
+        return iterator_at(find_index(key));
+    }
+
+    ValueType& operator[](const KeyType& key) {
+        auto iter = find(key);
+        if (iter == end()) {
+            // Insert default value if an element was not found.
+            iter = insert({key, ValueType()});
+        }
+        return iter->second;
+    }
+
+    const ValueType& at(const KeyType& key) const {
+        const_iterator iter = find(key);
+        if (iter == end())
+            throw std::out_of_range("no such element");
+        return iter->second;
+    }
+
+    void clear() {
+        destroy_table();
+        InitializeTable();
+    }
+
+    void swap(FlatHashMap& other) noexcept {
+        std::swap(hasher_, other.hasher_);
+        std::swap(slots_, other.slots_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(shift_, other.shift_);
+        std::swap(num_elements_, other.num_elements_);
+    }
+
+    Hash hash_function() const {
+        return hasher_;
+    }
+
+    size_t size() const {
+        return num_elements_;
+    }
+
+    bool empty() const {
+        return num_elements_ == 0;
+    }
+
+    iterator begin() {
+        return iterator_at(0);
+    }
+    iterator end() {
+        return iterator_at(capacity_);
+    }
+    const_iterator begin() const {
+        return iterator_at(0);
+    }
+    const_iterator end() const {
+        return iterator_at(capacity_);
+    }
+
+    ~FlatHashMap() {
+        destroy_table();
+    }
+};
@@ -1,9 +1,33 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <exception>
 #include <iostream>
+#include <iterator>
 #include <vector>
 #include <list>
+#include <memory>
+#include <new>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "bucket_policy.h"
+#include "seeded_hash.h"
+#include "snapshot.h"
+
+// Define as 1 to count lookups and rehashes in HashMap::stats(); otherwise those counters stay zero and cost nothing.
+#ifndef HASH_MAP_ENABLE_STATS
+#define HASH_MAP_ENABLE_STATS 0
+#endif
 
 /**
  * We handle collisions by chain method.
@@ -11,95 +35,1387 @@
  * there in arbitrary order (that is storage_ field). Apart from that, there is a vector of lists, each element of those
  * being an iterator of storage_ (table_ field). So, in order to add a new element we push it in storage_, while
  * an iterator pointing on this new element is put in one of the lists from table_. Additionally, we perform rehashing when
- * the table size exceeds capacity_ * alpha.
+ * the table size exceeds capacity_ * max_load_factor(), which is 0.5 unless it is changed. reserve() and rehash() resize the
+ * table up front, with the same meaning as for std::unordered_map. The table never shrinks by itself unless
+ * min_load_factor() is set: then an erase that leaves the load factor below it rehashes the table down to the size
+ * the remaining elements need. shrink_to_fit() does the same on request.
+ * Both the nodes of storage_ and the nodes of the bucket lists are taken from Allocator (rebound to the node types),
+ * so a PoolAllocator from pool_allocator.h packs all of them into a few slabs. Built with PageOptions (page_memory.h),
+ * it maps the slabs and the bucket arrays on huge pages or on chosen NUMA nodes. clear() and the destructor visit every
+ * node to destroy it, except when the elements need no destructor and the map holds every node of such an arena: then
+ * they leave the lists as they are, free the bucket arrays and release the arena, in time linear in bucket_count()
+ * but without touching a node.
+ * Unless CacheHash is turned off, every bucket entry also stores the full hash of its key. Rehashing then never calls
+ * the hasher, and a chain walk compares keys only when the cached hashes are equal. By default hashes are cached for
+ * every key except the scalar ones hashed by std::hash.
+ * With incremental rehashing turned on, growing the table does not move all the entries at once. The old bucket array
+ * is kept as old_table_ and every insert, erase and non-const find moves the last few of its buckets into table_ and
+ * destroys them, the way Redis dict does, as many as it takes to be done half way to the next growth with any
+ * max_load_factor(). A key whose old bucket has not been moved yet, also a new one, stays in old_table_, so a lookup
+ * still walks a single chain. The new array is not built at the growth either: once the load is half way there, every
+ * operation builds a few more of its buckets. So the work of a rehash is spread over the operations; a single one at
+ * most allocates the next array, without building it, or frees an emptied one. A rehash that the insertions did not
+ * lead up to, by reserve(), rehash(), shrinking or a change of max_load_factor(), still builds its array at once.
+ * stats() reports the distribution of chain lengths and the memory taken by the table. Built with
+ * HASH_MAP_ENABLE_STATS, it also counts find hits and misses, and the number and duration of rehashes.
+ * Every map mixes a random seed of its own into the bucket index. If an insertion makes a chain longer than
+ * kMaxChainLength, the map picks a new seed, reseeds a hasher that supports it (see SeededHash in seeded_hash.h) and
+ * rehashes. That bounds the chains under hostile keys for SeededHash. For other hashers it only helps against keys
+ * whose hashes differ but share a bucket.
+ * BucketPolicy turns hashes into bucket indices and rounds the capacity to the sizes it supports, see bucket_policy.h.
+ * If both Hash and KeyEqual define is_transparent, find, erase, at and operator[] accept any key type they can handle,
+ * e.g. a map with StringHash and std::equal_to<> is searched by std::string_view without building an std::string.
+ * Elements are built right in their storage_ nodes: insert, emplace, try_emplace, insert_or_assign and operator[] copy
+ * or move the key and the value exactly once, and, whenever the key is known up front, only if it is not in the table.
+ * find_batch and contains_batch look many keys up at once, prefetching the buckets and nodes of a whole group of keys
+ * before comparing any of them, so that the memory latency of different keys overlaps instead of adding up.
+ * Range construction and range insert size the table once when the length of the range is known. A large random
+ * access range inserted into an empty map is built in parallel: the keys are hashed by several threads, split by bucket
+ * between them and deduplicated there, and then the elements are linked in without any lookups or rehashes.
+ * Maps of trivially copyable keys and values can be saved to a snapshot file (see snapshot.h) and loaded back, or the
+ * file can be served read-only by MappedHashMap without loading it.
+ * erase() also takes iterators and ranges: every node of storage_ keeps the position of its bucket entry, so an element
+ * is unlinked in constant time, without searching its chain or comparing any key. erase_if() sweeps the chains and
+ * erases what a predicate selects without hashing anything.
+ * extract() takes an element out as a node handle and insert() links such a node into another map; merge() moves all
+ * the elements with new keys. With equal allocators they relink the nodes of the element and of its bucket entry, so
+ * nothing is allocated, copied or destroyed.
+ * Element says how the nodes of storage_ hold the keys. HashSet (hash_set.h) and HashMultiMap (hash_multimap.h) are
+ * built on this class with their own elements and insertion modes, so they share everything else with it.
+ * move_to_front and move_to_back reorder the iteration without touching the buckets; LruHashMap in lru_hash_map.h
+ * keeps its recency order that way.
  */
 
-template<class KeyType, class ValueType, class Hash = std::hash<KeyType> >
+namespace hash_map_detail {
+
+template<class KeyType, class Hash>
+struct is_cheap_hash : std::integral_constant<bool, std::is_same<Hash, std::hash<KeyType>>::value &&
+                                                    (std::is_arithmetic<KeyType>::value ||
+                                                     std::is_enum<KeyType>::value ||
+                                                     std::is_pointer<KeyType>::value)> {};
+
+// Element of a bucket list: an iterator of storage_ together with the hash of its key.
+template<class Iterator, bool CacheHash>
+struct BucketEntry {
+    Iterator it;
+    size_t hash;
+
+    BucketEntry(Iterator iter, size_t key_hash) : it(iter), hash(key_hash) {}
+
+    bool may_match(size_t key_hash) const {
+        return hash == key_hash;
+    }
+};
+
+template<class Iterator>
+struct BucketEntry<Iterator, false> {
+    Iterator it;
+
+    BucketEntry(Iterator iter, size_t) : it(iter) {}
+
+    bool may_match(size_t) const {
+        return true;
+    }
+};
+
+// Iterator over the nodes of storage_ that shows only their elements, not the bucket entry positions kept next to
+// them. Any iterator converts into the const one, whose NodeIterator and Value are const.
+template<class NodeIterator, class Value>
+class ElementIterator {
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = typename std::remove_const<Value>::type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = Value*;
+    using reference = Value&;
+
+    ElementIterator() = default;
+
+    explicit ElementIterator(NodeIterator node) : node_(node) {}
+
+    template<class OtherIterator, class OtherValue,
+             class = typename std::enable_if<std::is_convertible<OtherIterator, NodeIterator>::value>::type>
+    ElementIterator(const ElementIterator<OtherIterator, OtherValue>& other) : node_(other.base()) {}
+
+    reference operator*() const {
+        return node_->value;
+    }
+
+    pointer operator->() const {
+        return &node_->value;
+    }
+
+    ElementIterator& operator++() {
+        ++node_;
+        return *this;
+    }
+
+    ElementIterator operator++(int) {
+        return ElementIterator(node_++);
+    }
+
+    ElementIterator& operator--() {
+        --node_;
+        return *this;
+    }
+
+    ElementIterator operator--(int) {
+        return ElementIterator(node_--);
+    }
+
+    friend bool operator==(const ElementIterator& lhs, const ElementIterator& rhs) {
+        return lhs.node_ == rhs.node_;
+    }
+
+    friend bool operator!=(const ElementIterator& lhs, const ElementIterator& rhs) {
+        return lhs.node_ != rhs.node_;
+    }
+
+    const NodeIterator& base() const {
+        return node_;
+    }
+
+private:
+    NodeIterator node_;
+};
+
+// How the elements of storage_ hold their keys: HashMap and HashMultiMap store 'key, value' pairs, HashSet only keys.
+template<class KeyType, class ValueType>
+struct PairElement {
+    using type = std::pair<const KeyType, ValueType>;
+
+    static const KeyType& key(const type& element) {
+        return element.first;
+    }
+};
+
+template<class KeyType>
+struct KeyElement {
+    using type = KeyType;
+
+    static const KeyType& key(const type& element) {
+        return element;
+    }
+};
+
+// The mapped type of the HashMap that a HashSet is built on, which no element contains.
+struct NoValue {};
+
+template<class Hash, class KeyEqual, class = void>
+struct is_transparent : std::false_type {};
+
+template<class Hash, class KeyEqual>
+struct is_transparent<Hash, KeyEqual, std::void_t<typename Hash::is_transparent, typename KeyEqual::is_transparent>>
+    : std::true_type {};
+
+// Arguments of emplace that are a single pair with a KeyType, so the key may be looked up before building the element.
+template<class KeyType, class T>
+struct is_pair_with_key : std::false_type {};
+
+template<class KeyType, class K, class V>
+struct is_pair_with_key<KeyType, std::pair<K, V>> : std::is_same<typename std::remove_const<K>::type, KeyType> {};
+
+template<class KeyType, class... Args>
+struct is_key_pair : std::false_type {};
+
+template<class KeyType, class Arg>
+struct is_key_pair<KeyType, Arg> : is_pair_with_key<KeyType, typename std::decay<Arg>::type> {};
+
+// Arguments of emplace that are a KeyType followed by the value.
+template<class KeyType, class... Args>
+struct is_key_and_value : std::false_type {};
+
+template<class KeyType, class K, class V>
+struct is_key_and_value<KeyType, K, V> : std::is_same<typename std::decay<K>::type, KeyType> {};
+
+// Hashers such as SeededHash that can be given a fresh random seed.
+template<class Hash, class = void>
+struct is_reseedable : std::false_type {};
+
+template<class Hash>
+struct is_reseedable<Hash, std::void_t<decltype(std::declval<Hash&>().reseed())>> : std::true_type {};
+
+// Allocators such as PoolAllocator that can free all of their nodes at once, see HashMap::drop_nodes().
+template<class Allocator, class = void>
+struct is_bulk_releasable : std::false_type {};
+
+template<class Allocator>
+struct is_bulk_releasable<Allocator, std::void_t<decltype(std::declval<const Allocator&>().unowned()),
+                                                 decltype(std::declval<const Allocator&>().live_nodes()),
+                                                 decltype(std::declval<const Allocator&>().release())>>
+    : std::true_type {};
+
+// Ends the lifetime of the nodes of 'list' without visiting them: they are spliced into a list that is never destroyed
+// and whose allocator, equal to the one of 'list', does not own anything. The caller frees their memory wholesale.
+template<class List, class Alloc>
+void abandon_nodes(List& list, const Alloc& unowned) noexcept {
+    alignas(List) unsigned char storage[sizeof(List)];
+    List* abandoned = new (storage) List(unowned);
+    abandoned->splice(abandoned->end(), list);
+}
+
+// The same for an array of lists whose allocators own nothing: the array is freed without destroying the lists.
+template<class Vector, class Alloc>
+void abandon_array(Vector& array, const Alloc& unowned) noexcept {
+    auto alloc = array.get_allocator();
+    auto data = array.data();
+    size_t capacity = array.capacity();
+    alignas(Vector) unsigned char storage[sizeof(Vector)];
+    // Equal allocators let the new vector take over the array instead of moving the lists one by one.
+    new (storage) Vector(std::move(array), unowned);
+    if (capacity != 0)
+        std::allocator_traits<decltype(alloc)>::deallocate(alloc, data, capacity);
+    Vector(alloc).swap(array);
+}
+
+inline void prefetch(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
+}
+
+constexpr bool kStatsEnabled = HASH_MAP_ENABLE_STATS != 0;
+
+// Counter that const lookups may bump concurrently, as they do under the shared locks of ConcurrentHashMap.
+class StatCounter {
+public:
+    StatCounter() = default;
+    StatCounter(const StatCounter& other) : value_(other.load()) {}
+    StatCounter& operator= (const StatCounter& other) {
+        value_.store(other.load(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    void add(uint64_t count) {
+        value_.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    uint64_t load() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+template<bool Enabled>
+struct StatCounters {
+    StatCounter find_hits;
+    StatCounter find_misses;
+    StatCounter rehashes;
+    StatCounter rehash_nanoseconds;
+
+    void count_find(bool hit) {
+        (hit ? find_hits : find_misses).add(1);
+    }
+
+    void count_rehash() {
+        rehashes.add(1);
+    }
+
+    // Adds the time until the returned object is destroyed to rehash_nanoseconds.
+    auto time_rehash() {
+        struct Timer {
+            StatCounter& total;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            ~Timer() {
+                auto elapsed = std::chrono::steady_clock::now() - start;
+                total.add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            }
+        };
+        return Timer{rehash_nanoseconds};
+    }
+};
+
+// With the stats compiled out every call is empty and gets optimized away.
+template<>
+struct StatCounters<false> {
+    void count_find(bool) {}
+    void count_rehash() {}
+    int time_rehash() {
+        return 0;
+    }
+};
+
+}  // namespace hash_map_detail
+
+// What HashMap::stats() reports. The counters are only maintained with HASH_MAP_ENABLE_STATS and stay zero otherwise;
+// the rest is computed from the table when stats() is called.
+struct HashMapStats {
+    // chain_lengths[i] buckets hold i elements, for i up to max_chain_length.
+    std::vector<size_t> chain_lengths;
+    size_t max_chain_length = 0;
+    // Bytes taken by the element nodes, the bucket entry nodes and the bucket arrays, not counting allocator overhead.
+    size_t bytes_allocated = 0;
+    uint64_t rehash_count = 0;
+    std::chrono::nanoseconds rehash_time{0};
+    uint64_t find_hits = 0;
+    uint64_t find_misses = 0;
+};
+
+// Transparent hasher of strings, which gives the same hash for std::string, std::string_view and const char*.
+struct StringHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view str) const {
+        return std::hash<std::string_view>()(str);
+    }
+};
+
+template<class KeyType, class Hash, class KeyEqual, class Allocator, bool CacheHash, class BucketPolicy>
+class HashSet;
+
+template<class KeyType, class ValueType, class Hash, class KeyEqual, class Allocator, bool CacheHash,
+         class BucketPolicy>
+class HashMultiMap;
+
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class KeyEqual = std::equal_to<KeyType>,
+         class Allocator = std::allocator<std::pair<const KeyType, ValueType>>,
+         bool CacheHash = !hash_map_detail::is_cheap_hash<KeyType, Hash>::value,
+         class BucketPolicy = PowerOfTwoBucketPolicy, class Element = hash_map_detail::PairElement<KeyType, ValueType>>
 class HashMap {
+    template<class T>
+    using rebind_alloc = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+    // Node value of storage_, defined below once the type of the bucket entries is known.
+    struct stored_element;
+    using storage_type = std::list<stored_element, rebind_alloc<stored_element>>;
+    using node_iterator = typename storage_type::iterator;
+    using bucket_entry = hash_map_detail::BucketEntry<node_iterator, CacheHash>;
+    using bucket = std::list<bucket_entry, rebind_alloc<bucket_entry>>;
+    using iterator_vector = std::vector<bucket, rebind_alloc<bucket>>;
+
+    // An element together with the position of its bucket entry, so that erasing the element by iterator unlinks the
+    // entry without searching its chain.
+    struct stored_element {
+        template<class... Args>
+        explicit stored_element(std::in_place_t, Args&&... args) : value(std::forward<Args>(args)...) {}
+
+        typename Element::type value;
+        typename bucket::iterator entry;
+    };
+
+    // The set and the multimap are built on this engine and use the private element operations below.
+    template<class, class, class, class, bool, class> friend class HashSet;
+    template<class, class, class, class, class, bool, class> friend class HashMultiMap;
+
 public:
-    using iterator = typename std::list<std::pair<const KeyType, ValueType>>::iterator;
-    using const_iterator = typename std::list<std::pair<const KeyType, ValueType>>::const_iterator;
+    using iterator = hash_map_detail::ElementIterator<node_iterator, typename Element::type>;
+    using const_iterator = hash_map_detail::ElementIterator<typename storage_type::const_iterator,
+                                                            const typename Element::type>;
+    using allocator_type = Allocator;
 
 private:
-    using iterator_vector = typename std::vector<std::list<iterator>>;
-    std::list<std::pair<const KeyType, ValueType>> storage_;
+    // Lookups by another key type K are allowed if both Hash and KeyEqual are transparent.
+    template<class K>
+    using if_transparent = typename std::enable_if<hash_map_detail::is_transparent<Hash, KeyEqual>::value &&
+                                                   !std::is_convertible<const K&, const_iterator>::value, int>::type;
+
+public:
+    // Owns an element taken out of a map by extract(), together with its bucket entry, so that insert() can link it
+    // into another map of the same type without allocating. Keys cannot be changed through a node.
+    class node_type {
+    public:
+        using key_type = KeyType;
+        using mapped_type = ValueType;
+        using allocator_type = Allocator;
+
+        node_type() = default;
+
+        bool empty() const {
+            return element_.empty();
+        }
+
+        explicit operator bool() const {
+            return !empty();
+        }
+
+        const KeyType& key() const {
+            return key_of(element_.front());
+        }
+
+        ValueType& mapped() {
+            return element_.front().value.second;
+        }
+
+        const ValueType& mapped() const {
+            return element_.front().value.second;
+        }
+
+        allocator_type get_allocator() const {
+            return allocator_type(element_.get_allocator());
+        }
+
+    private:
+        friend class HashMap;
+
+        explicit node_type(const Allocator& alloc) : element_(alloc), entry_(rebind_alloc<bucket_entry>(alloc)) {}
+
+        storage_type element_;
+        bucket entry_;
+    };
+
+    struct insert_return_type {
+        iterator position;
+        bool inserted;
+        node_type node;
+    };
+
+private:
+    storage_type storage_;
     Hash hasher_;
-    const int32_t kInvAlpha = 2;
-    int32_t capacity_;
-    std::vector<std::list<iterator>> table_;
-    int32_t num_elements_ = 0;
+    KeyEqual key_equal_;
+    static constexpr size_t kInitialCapacity = 16;
+    static constexpr size_t kGrowthFactor = 2;
+    static constexpr size_t kRehashStep = 4;
+    static constexpr size_t kBatchSize = 16;
+    static constexpr size_t kParallelBuildThreshold = 1 << 16;
+    static constexpr size_t kMaxChainLength = 32;
+    float max_load_factor_ = kDefaultMaxLoadFactor;
+    // Zero turns automatic shrinking off.
+    float min_load_factor_ = 0;
+    // Zero in a map that has been moved from, which gets its buckets back with its first insertion.
+    size_t capacity_ = 0;
+    BucketPolicy policy_;
+    iterator_vector table_;
+    size_t num_elements_ = 0;
+    bool incremental_rehash_ = false;
+    // The buckets of the previous array that are still to be moved into table_. They are moved from the back, and
+    // each is destroyed right after, so the array shrinks as the rehash goes on.
+    iterator_vector old_table_;
+    BucketPolicy old_policy_;
+    // With incremental rehashing, the bucket array for the next growth, to spare_capacity_ buckets, which
+    // build_spare_buckets() fills a few buckets per operation before the growth needs it.
+    iterator_vector spare_table_;
+    size_t spare_capacity_ = 0;
+    size_t seed_ = random_seed();
+    // The flooding guard reseeds at most once per capacity, so keys whose full hashes collide cannot make every
+    // insertion rehash.
+    size_t reseeded_capacity_ = 0;
+    mutable hash_map_detail::StatCounters<hash_map_detail::kStatsEnabled> stats_;
 
-    int32_t ApplyHash(const KeyType obj) const {
-        return hasher_(obj) % capacity_;
+    template<class K>
+    size_t ApplyHash(const K& obj) const {
+        return hasher_(obj);
     }
 
-    void InitializeTable(const int32_t capacity = 16) {
-        capacity_ = capacity;
-        table_ = iterator_vector(capacity_);
+    static const KeyType& key_of(const typename Element::type& element) {
+        return Element::key(element);
+    }
+
+    static const KeyType& key_of(const stored_element& node) {
+        return Element::key(node.value);
+    }
+
+    // The seed of the map takes part in choosing the bucket, so the chains differ from map to map.
+    size_t bucket_index(size_t hash) const {
+        return policy_.index(hash ^ seed_);
+    }
+
+    bool rehashing() const {
+        return !old_table_.empty();
+    }
+
+    // The chain that holds the keys with this hash. During an incremental rehash that is the bucket of old_table_ until
+    // the bucket is moved, for new keys as well, so every key is in exactly one chain its hash leads to.
+    bucket& chain_for(size_t hash) {
+        if (rehashing()) {
+            size_t old_index = old_policy_.index(hash ^ seed_);
+            if (old_index < old_table_.size())
+                return old_table_[old_index];
+        }
+        return table_[bucket_index(hash)];
+    }
+
+    // Points the element at its bucket entry, which has just been linked.
+    static void link_entry(typename bucket::iterator entry) {
+        entry->it->entry = entry;
+    }
+
+    size_t entry_hash(const bucket_entry& entry) const {
+        if constexpr (CacheHash) {
+            return entry.hash;
+        } else {
+            return ApplyHash(key_of(*entry.it));
+        }
+    }
+
+    void InitializeTable(const size_t capacity = kInitialCapacity) {
+        size_t rounded = BucketPolicy::round_capacity(capacity);
+        capacity_ = rounded;
+        policy_.reset(rounded);
+        if (spare_capacity_ == rounded) {
+            // Whatever build_spare_buckets() has not built yet is added below.
+            table_ = std::move(spare_table_);
+        } else {
+            table_ = iterator_vector(get_allocator());
+            table_.reserve(capacity_);
+        }
+        spare_table_ = iterator_vector(get_allocator());
+        spare_capacity_ = 0;
+        // Buckets are emplaced one by one, since copying a bucket would select a new allocator for it.
+        for (size_t i = table_.size(); i < capacity_; ++i)
+            table_.emplace_back(bucket_allocator());
+    }
+
+    // The allocator of the bucket lists. Where the allocator can drop its nodes wholesale, the lists get a copy that
+    // does not own the memory, so that drop_nodes() may abandon them; storage_ and the arrays keep it alive.
+    rebind_alloc<bucket_entry> bucket_allocator() const {
+        if constexpr (hash_map_detail::is_bulk_releasable<Allocator>::value)
+            return rebind_alloc<bucket_entry>(get_allocator().unowned());
+        else
+            return rebind_alloc<bucket_entry>(get_allocator());
+    }
+
+    // Frees the elements and the bucket entries without visiting them, when nothing needs to be destroyed and every
+    // node of the arena belongs to this map: no other container and no node handle holds one. The lists are abandoned,
+    // the bucket arrays freed as they are and the arena released. Returns false if that cannot be done.
+    bool drop_nodes() noexcept {
+        if constexpr (hash_map_detail::is_bulk_releasable<Allocator>::value &&
+                      std::is_trivially_destructible<stored_element>::value &&
+                      std::is_trivially_destructible<bucket_entry>::value) {
+            Allocator alloc = get_allocator();
+            // Every element is one node of storage_ and one bucket entry. A map that has just been moved from still
+            // has its old size while storage_ is empty already, and must leave the arena to the new owner.
+            if (storage_.size() != num_elements_ || alloc.live_nodes() != 2 * num_elements_)
+                return false;
+            Allocator unowned = alloc.unowned();
+            hash_map_detail::abandon_nodes(storage_, unowned);
+            hash_map_detail::abandon_array(table_, rebind_alloc<bucket>(unowned));
+            hash_map_detail::abandon_array(old_table_, rebind_alloc<bucket>(unowned));
+            hash_map_detail::abandon_array(spare_table_, rebind_alloc<bucket>(unowned));
+            spare_capacity_ = 0;
+            alloc.release();
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    // Copies the element of a bucket entry of another map to the end of 'chain', keeping the cached hash.
+    void clone_entry(bucket& chain, const bucket_entry& entry) {
+        storage_.emplace_back(std::in_place, entry.it->value);
+        bucket_entry copy = entry;
+        copy.it = std::prev(storage_.end());
+        try {
+            chain.push_back(copy);
+        } catch (...) {
+            storage_.pop_back();
+            throw;
+        }
+        link_entry(std::prev(chain.end()));
+        ++num_elements_;
+    }
+
+    // Fills this map, which has no buckets yet, with copies of the elements of 'other' in the iteration order of
+    // 'other', into a table of the same capacity under the same seed. The keys are known to be unique, so nothing is
+    // looked up: every element goes into the bucket its entry hash gives, which is read from the cache when there is
+    // one. A rehash of 'other' in progress is completed in the copy.
+    void clone_from(const HashMap& other) {
+        if (other.capacity_ == 0)
+            return;
+        InitializeTable(other.capacity_);
+        for (auto &node : other.storage_) {
+            const bucket_entry& entry = *node.entry;
+            clone_entry(table_[bucket_index(other.entry_hash(entry))], entry);
+        }
+    }
+
+    // Gives a map that has been moved from its buckets back before something is linked into them.
+    void ensure_table() {
+        if (capacity_ == 0)
+            InitializeTable();
+    }
+
+    // Destroys the elements and gives the bucket arrays back without allocating anything, so that it may be done in
+    // moves and in the destructor. The map is left without buckets, see ensure_table().
+    void release_table() noexcept {
+        if (!drop_nodes())
+            storage_.clear();
+        iterator_vector(get_allocator()).swap(table_);
+        iterator_vector(get_allocator()).swap(old_table_);
+        iterator_vector(get_allocator()).swap(spare_table_);
+        capacity_ = 0;
+        num_elements_ = 0;
+        spare_capacity_ = 0;
+    }
+
+    // Links a new element of storage_, guaranteed not to be in the table, into its bucket.
+    iterator add_to_table(node_iterator it, size_t hash) {
+        bucket* chain;
+        try {
+            ensure_table();
+            chain = &chain_for(hash);
+            chain->emplace_back(it, hash);
+        } catch (...) {
+            storage_.erase(it);
+            throw;
+        }
+        link_entry(std::prev(chain->end()));
+        return count_linked(*chain, it);
+    }
+
+    // Counts an element that has just been linked into 'chain' and grows the table if it is needed.
+    iterator count_linked(bucket& chain, node_iterator it) {
+        ++num_elements_;
+        if (chain.size() > kMaxChainLength)
+            reseed();
+        try_to_rehash();
+        return iterator(it);
+    }
+
+    // Takes over the element of 'entry' from the list 'elements' and the entry itself from 'entries', which belong to
+    // another map or to a node handle, and decrements their size. With equal allocators both nodes are relinked, so
+    // nothing is allocated or copied; otherwise the element is moved into a new node. The key must not be in the
+    // table yet, and 'hash' is its hash under this map's hasher.
+    iterator adopt(storage_type& elements, bucket& entries, typename bucket::iterator entry, size_t hash,
+                   size_t& source_size) {
+        ensure_table();
+        node_iterator it = entry->it;
+        bucket& chain = chain_for(hash);
+        if (elements.get_allocator() == storage_.get_allocator()) {
+            // The element keeps pointing at its entry, which stays valid when it is spliced.
+            storage_.splice(storage_.end(), elements, it);
+            *entry = bucket_entry(it, hash);
+            chain.splice(chain.end(), entries, entry);
+        } else {
+            storage_.emplace_back(std::in_place, std::move(it->value));
+            try {
+                chain.emplace_back(std::prev(storage_.end()), hash);
+            } catch (...) {
+                storage_.pop_back();
+                throw;
+            }
+            link_entry(std::prev(chain.end()));
+            elements.erase(it);
+            entries.erase(entry);
+            it = std::prev(storage_.end());
+        }
+        --source_size;
+        return count_linked(chain, it);
+    }
+
+    // A chain this long means that the keys collide on purpose or that the hasher is poor. A new seed for the map,
+    // and for the hasher if it takes one, scatters keys whose hashes differ over other buckets.
+    void reseed() {
+        if (reseeded_capacity_ == capacity_)
+            return;
+        reseeded_capacity_ = capacity_;
+        if (rehashing())
+            move_old_buckets(old_table_.size());
+        if constexpr (hash_map_detail::is_reseedable<Hash>::value) {
+            hasher_.reseed();
+            if constexpr (CacheHash) {
+                for (auto &chain : table_) {
+                    for (auto &entry : chain)
+                        entry.hash = ApplyHash(key_of(entry.it->value));
+                }
+            }
+        }
+        seed_ = random_seed();
+        start_rehash(capacity_, false);
     }
 
     // Method that is called when a new element, guaranteed not be in the table, is added.
-    void add_to_storage(const std::pair<KeyType, ValueType> obj) {
-        int32_t hashed = ApplyHash(obj.first);
-        storage_.push_back(obj);
-        auto it = std::prev(storage_.end());
-        table_[hashed].push_back(it);
+    template<class... Args>
+    iterator add_to_storage(size_t hash, Args&&... args) {
+        storage_.emplace_back(std::in_place, std::forward<Args>(args)...);
+        return add_to_table(std::prev(storage_.end()), hash);
+    }
+
+    // Builds an element from 'args' unless 'key', which the element would get, is in the table already. The key is
+    // looked up before anything is built, so 'args' may move from it.
+    template<class K, class... Args>
+    std::pair<iterator, bool> emplace_unique(const K& key, Args&&... args) {
+        rehash_step();
+        size_t hash = ApplyHash(key);
+        iterator iter = find_in_bucket(key, hash);
+        if (iter != end())
+            return {iter, false};
+
+        return {add_to_storage(hash, std::forward<Args>(args)...), true};
+    }
+
+    // Builds the element before its key is known: in a list of its own, which is spliced into storage_ if the key is
+    // new.
+    template<class... Args>
+    std::pair<iterator, bool> emplace_node(Args&&... args) {
+        rehash_step();
+        storage_type node(get_allocator());
+        node.emplace_back(std::in_place, std::forward<Args>(args)...);
+        size_t hash = ApplyHash(key_of(node.front()));
+        iterator iter = find_in_bucket(key_of(node.front()), hash);
+        if (iter != end())
+            return {iter, false};
+
+        storage_.splice(storage_.end(), node);
+        return {add_to_table(std::prev(storage_.end()), hash), true};
+    }
+
+    template<class P>
+    std::pair<iterator, bool> insert_pair(P&& obj) {
+        return emplace_unique(obj.first, std::forward<P>(obj));
+    }
+
+    template<class K, class... Args>
+    std::pair<iterator, bool> try_emplace_key(K&& key, Args&&... args) {
+        return emplace_unique(key, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                              std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    // Builds an element from 'args' even if its key is in the table. An element with an equal key is placed right
+    // after the first one, both in storage_ and in the chain, so that equal keys stay next to each other and the first
+    // match of a chain walk is the first of them.
+    template<class... Args>
+    iterator emplace_equal(Args&&... args) {
+        rehash_step();
+        storage_type node(get_allocator());
+        node.emplace_back(std::in_place, std::forward<Args>(args)...);
+        node_iterator it = node.begin();
+        size_t hash = ApplyHash(key_of(*it));
+        auto entry = find_entry(key_of(*it), hash);
+        if (entry.first == nullptr) {
+            storage_.splice(storage_.end(), node);
+            return add_to_table(it, hash);
+        }
+
+        storage_.splice(std::next(entry.second->it), node);
+        try {
+            link_entry(entry.first->emplace(std::next(entry.second), it, hash));
+        } catch (...) {
+            storage_.erase(it);
+            throw;
+        }
+        // Equal keys lengthen the chain without being a sign of flooding, so there is no reseed check.
+        ++num_elements_;
+        try_to_rehash();
+        return iterator(it);
+    }
+
+    // The elements with the key, which are next to each other in storage_.
+    template<class K>
+    std::pair<iterator, iterator> equal_range_key(const K& key) {
+        iterator first = find_in_bucket(key, ApplyHash(key));
+        iterator last = first;
+        while (last != end() && key_equal_(key_of(*last), key))
+            ++last;
+        return {first, last};
+    }
+
+    template<class K, class M>
+    std::pair<iterator, bool> assign_key(K&& key, M&& obj) {
+        rehash_step();
+        size_t hash = ApplyHash(key);
+        iterator iter = find_in_bucket(key, hash);
+        if (iter != end()) {
+            iter->second = std::forward<M>(obj);
+            return {iter, false};
+        }
+
+        return {add_to_storage(hash, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                               std::forward_as_tuple(std::forward<M>(obj))), true};
+    }
+
+    // Moves up to 'count' buckets from the back of old_table_ into table_ and destroys them. Bucket entries are
+    // spliced, so that no node is reallocated.
+    void move_old_buckets(size_t count) {
+        for (; count > 0 && !old_table_.empty(); --count) {
+            bucket &chain = old_table_.back();
+            while (!chain.empty()) {
+                bucket &target = table_[bucket_index(entry_hash(chain.front()))];
+                target.splice(target.end(), chain, chain.begin());
+            }
+            old_table_.pop_back();
+        }
+        if (old_table_.empty())
+            old_table_ = iterator_vector(get_allocator());
+    }
+
+    // Once the load is half way to the next growth, builds the next few buckets of the array that growth will take,
+    // as many per call as it takes to have all of them by the growth when every call is an insertion.
+    void build_spare_buckets() {
+        double threshold = static_cast<double>(capacity_) * max_load_factor_;
+        if (capacity_ == 0 || num_elements_ < threshold / 2)
+            return;
+        size_t capacity = BucketPolicy::round_capacity(capacity_ * kGrowthFactor);
+        if (spare_capacity_ != capacity) {
+            spare_table_ = iterator_vector(get_allocator());
+            spare_table_.reserve(capacity);
+            spare_capacity_ = capacity;
+        }
+        size_t count = spread_step(spare_capacity_ - spare_table_.size(), insertions_to_growth());
+        for (size_t i = 0; i < count; ++i)
+            spare_table_.emplace_back(bucket_allocator());
+    }
+
+    // Number of insertions left before the table grows.
+    double insertions_to_growth() const {
+        return static_cast<double>(capacity_) * max_load_factor_ - static_cast<double>(num_elements_);
+    }
+
+    // How many of 'left' buckets one call handles so that all of them are done within 'insertions' more calls.
+    static size_t spread_step(size_t left, double insertions) {
+        return std::min(left, static_cast<size_t>(static_cast<double>(left) / std::max(insertions, 1.0)) + kRehashStep);
+    }
+
+    // Old buckets to move per call: enough to empty old_table_ half way to the next growth, whatever the load factor,
+    // and leave the other half of the insertions to build_spare_buckets().
+    size_t old_buckets_step() const {
+        return spread_step(old_table_.size(), insertions_to_growth() / 2);
+    }
+
+    void rehash_step() {
+        if (rehashing()) {
+            auto timer = stats_.time_rehash();
+            (void)timer;
+            move_old_buckets(old_buckets_step());
+        } else if (incremental_rehash_) {
+            build_spare_buckets();
+        }
+    }
+
+    // Smallest capacity that keeps 'count' elements within the maximal load factor.
+    size_t min_capacity_for(size_t count) const {
+        double capacity = std::ceil(static_cast<double>(count) / max_load_factor_);
+        if (capacity >= static_cast<double>(SIZE_MAX / 2))
+            throw std::length_error("hash table is too large");
+        return std::max(static_cast<size_t>(capacity), size_t(1));
+    }
+
+    // Moves all the entries into a new bucket array, either at once or a few buckets per operation.
+    void start_rehash(size_t capacity, bool incremental) {
+        auto timer = stats_.time_rehash();
+        (void)timer;
+        // A rehash that has not kept up with the insertions is completed before the next one starts.
+        if (rehashing())
+            move_old_buckets(old_table_.size());
+        stats_.count_rehash();
+        old_table_ = std::move(table_);
+        old_policy_ = policy_;
+        try {
+            InitializeTable(capacity);
+        } catch (...) {
+            // The table stays as it was.
+            table_ = std::move(old_table_);
+            capacity_ = table_.size();
+            policy_ = old_policy_;
+            old_table_ = iterator_vector(get_allocator());
+            throw;
+        }
+        move_old_buckets(incremental ? old_buckets_step() : old_table_.size());
     }
 
     // Performing rehashing
     void try_to_rehash() {
-        if (num_elements_ * kInvAlpha < capacity_)
+        if (num_elements_ <= static_cast<double>(capacity_) * max_load_factor_)
+            return;
+
+        start_rehash(std::max(capacity_ * kGrowthFactor, min_capacity_for(num_elements_)), incremental_rehash_);
+    }
+
+    // Rehashes down to the capacity the current size needs once the load factor falls below min_load_factor_.
+    void try_to_shrink() {
+        if (capacity_ <= kInitialCapacity || num_elements_ >= static_cast<double>(capacity_) * min_load_factor_)
             return;
 
-        table_.clear();
-        capacity_ *= kInvAlpha;
-        InitializeTable(capacity_);
-        for (auto iter = storage_.begin(); iter != storage_.end(); ++iter) {
-            table_[ApplyHash(iter->first)].push_back(iter);
+        start_rehash(std::max(min_capacity_for(num_elements_), kInitialCapacity), incremental_rehash_);
+    }
+
+    // Returns the chain holding the key together with the key's position there, or a null chain.
+    template<class K>
+    std::pair<bucket*, typename bucket::iterator> find_entry(const K& key, size_t hash) {
+        if (capacity_ == 0)
+            return {nullptr, typename bucket::iterator()};
+        bucket& chain = chain_for(hash);
+        for (auto iter = chain.begin(); iter != chain.end(); ++iter) {
+            if (iter->may_match(hash) && key_equal_(key_of(*iter->it), key))
+                return {&chain, iter};
         }
+
+        return {nullptr, typename bucket::iterator()};
+    }
+
+    template<class K>
+    iterator find_in_bucket(const K& key, size_t hash) {
+        auto entry = find_entry(key, hash);
+        return entry.first != nullptr ? iterator(entry.second->it) : end();
+    }
+
+    template<class K>
+    const_iterator find_in_bucket(const K& key, size_t hash) const {
+        // The lookup itself modifies nothing.
+        return const_cast<HashMap*>(this)->find_in_bucket(key, hash);
+    }
+
+    template<class K>
+    void erase_key(const K& to_delete) {
+        rehash_step();
+        auto entry = find_entry(to_delete, ApplyHash(to_delete));
+        if (entry.first == nullptr)
+            return;
+
+        storage_.erase(entry.second->it);
+        entry.first->erase(entry.second);
+        --num_elements_;
+        try_to_shrink();
+    }
+
+    // Unlinks the element at 'pos' through the position of its bucket entry, so no chain is searched and no key is
+    // compared. Only the chain that holds the entry has to be known: its hash is read from the entry, or computed
+    // when hashes are not cached, which is by default only for keys that std::hash maps to themselves.
+    iterator erase_at(const_iterator pos) {
+        rehash_step();
+        typename bucket::iterator entry = pos.base()->entry;
+        chain_for(entry_hash(*entry)).erase(entry);
+        node_iterator next = storage_.erase(pos.base());
+        --num_elements_;
+        try_to_shrink();
+        return iterator(next);
+    }
+
+    // Erases the elements of the chains [first, last) of 'chains' that satisfy the predicate and returns their number.
+    template<class Predicate>
+    size_t erase_from_chains(iterator_vector& chains, size_t first, size_t last, Predicate& pred) {
+        size_t count = 0;
+        for (size_t i = first; i < last; ++i) {
+            bucket& chain = chains[i];
+            for (auto entry = chain.begin(); entry != chain.end();) {
+                if (pred(entry->it->value)) {
+                    storage_.erase(entry->it);
+                    entry = chain.erase(entry);
+                    ++count;
+                } else {
+                    ++entry;
+                }
+            }
+        }
+        return count;
+    }
+
+    template<class K>
+    node_type extract_key(const K& key) {
+        rehash_step();
+        node_type node(get_allocator());
+        auto entry = find_entry(key, ApplyHash(key));
+        if (entry.first == nullptr)
+            return node;
+
+        node.element_.splice(node.element_.end(), storage_, entry.second->it);
+        node.entry_.splice(node.entry_.end(), *entry.first, entry.second);
+        --num_elements_;
+        try_to_shrink();
+        return node;
+    }
+
+    // The lookup behind every public find, which is the one counted in the stats.
+    template<class K>
+    iterator lookup(const K& key, size_t hash) const {
+        HashMap* self = const_cast<HashMap*>(this);
+        iterator iter = self->find_in_bucket(key, hash);
+        stats_.count_find(iter != self->end());
+        return iter;
+    }
+
+    // Looks the keys up in groups of kBatchSize. A group first hashes all of its keys and prefetches their buckets, then
+    // prefetches the first entry of every chain and the element it points to, and only then compares the keys.
+    template<class ForwardIt, class Visitor>
+    void lookup_batch(ForwardIt first, ForwardIt last, Visitor&& visit) {
+        if (capacity_ == 0) {
+            for (; first != last; ++first)
+                visit(end());
+            return;
+        }
+        size_t hashes[kBatchSize];
+        bucket* chains[kBatchSize];
+        while (first != last) {
+            ForwardIt group = first;
+            size_t count = 0;
+            for (; count < kBatchSize && first != last; ++count, ++first) {
+                hashes[count] = ApplyHash(*first);
+                chains[count] = &chain_for(hashes[count]);
+                hash_map_detail::prefetch(chains[count]);
+            }
+            for (size_t i = 0; i < count; ++i) {
+                if (!chains[i]->empty())
+                    hash_map_detail::prefetch(&chains[i]->front());
+            }
+            for (size_t i = 0; i < count; ++i) {
+                if (!chains[i]->empty())
+                    hash_map_detail::prefetch(&*chains[i]->front().it);
+            }
+            for (size_t i = 0; i < count; ++i, ++group)
+                visit(lookup(*group, hashes[i]));
+        }
+    }
+
+    // Grows the table for 'count' more elements unless they fit already, so that range inserts into a table that has
+    // room do not rebuild it.
+    void reserve_more(size_t count) {
+        if (min_capacity_for(num_elements_ + count) > capacity_)
+            reserve(num_elements_ + count);
+    }
+
+    template<class It>
+    void insert_range(It first, It last) {
+        using category = typename std::iterator_traits<It>::iterator_category;
+        using element = typename std::iterator_traits<It>::value_type;
+        if constexpr (std::is_base_of<std::forward_iterator_tag, category>::value) {
+            size_t count = static_cast<size_t>(std::distance(first, last));
+            reserve_more(count);
+            if constexpr (std::is_base_of<std::random_access_iterator_tag, category>::value &&
+                          hash_map_detail::is_pair_with_key<KeyType, element>::value) {
+                if (empty() && count >= kParallelBuildThreshold && std::thread::hardware_concurrency() > 1) {
+                    build_parallel(first, count);
+                    return;
+                }
+            }
+        }
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+    // Calls fn(thread, begin, end) for num_threads consecutive parts of [0, count) in parallel.
+    template<class F>
+    static void run_in_threads(size_t num_threads, size_t count, F&& fn) {
+        std::vector<std::thread> threads;
+        threads.reserve(num_threads);
+        std::vector<std::exception_ptr> errors(num_threads);
+        try {
+            for (size_t t = 0; t < num_threads; ++t) {
+                threads.emplace_back([&, t] {
+                    try {
+                        fn(t, count * t / num_threads, count * (t + 1) / num_threads);
+                    } catch (...) {
+                        errors[t] = std::current_exception();
+                    }
+                });
+            }
+        } catch (...) {
+            // A thread failed to start. The ones that did use 'fn' and 'errors', so they are waited for first.
+            for (auto &thread : threads)
+                thread.join();
+            throw;
+        }
+        for (auto &thread : threads)
+            thread.join();
+        for (auto &error : errors) {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    }
+
+    // Fills the empty, already presized table from 'count' elements starting at 'first'. Every thread hashes a part
+    // of the elements. The elements are then counting-sorted into one partition of consecutive buckets per thread,
+    // and every thread sorts its partition by hash and drops the repeated keys, keeping the first occurrence the way
+    // insert does. Only keys with equal hashes are compared, each with the distinct keys kept for that hash.
+    // The linking of the remaining elements, which allocates nodes, is done by this thread, and a chain that has
+    // grown longer than kMaxChainLength makes the map reseed the way an insertion would.
+    template<class It>
+    void build_parallel(It first, size_t count) {
+        // The elements are linked into table_ only, so the buckets of a rehash in progress, which chain_for() would
+        // still send some of the keys to, are moved first. The map is empty, so they hold nothing.
+        if (rehashing())
+            move_old_buckets(old_table_.size());
+        size_t num_threads = std::min<size_t>(std::thread::hardware_concurrency(), count / (kParallelBuildThreshold / 4));
+        std::vector<size_t> hashes(count);
+        std::vector<size_t> buckets(count);
+        std::vector<std::vector<size_t>> partition_sizes(num_threads, std::vector<size_t>(num_threads));
+        const size_t capacity = capacity_;
+        auto partition_of = [capacity, num_threads](size_t bucket_id) {
+            return static_cast<size_t>(static_cast<unsigned long long>(bucket_id) * num_threads / capacity);
+        };
+
+        run_in_threads(num_threads, count, [&](size_t t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                hashes[i] = ApplyHash(first[i].first);
+                buckets[i] = bucket_index(hashes[i]);
+                ++partition_sizes[t][partition_of(buckets[i])];
+            }
+        });
+
+        // Element positions of partition p coming from the part of thread t start at offsets[t][p].
+        std::vector<std::vector<size_t>> offsets(num_threads, std::vector<size_t>(num_threads));
+        std::vector<size_t> partition_begin(num_threads + 1);
+        size_t offset = 0;
+        for (size_t p = 0; p < num_threads; ++p) {
+            partition_begin[p] = offset;
+            for (size_t t = 0; t < num_threads; ++t) {
+                offsets[t][p] = offset;
+                offset += partition_sizes[t][p];
+            }
+        }
+        partition_begin[num_threads] = offset;
+
+        std::vector<size_t> order(count);
+        run_in_threads(num_threads, count, [&](size_t t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+                order[offsets[t][partition_of(buckets[i])]++] = i;
+        });
+
+        std::vector<char> keep(count, 1);
+        run_in_threads(num_threads, num_threads, [&](size_t, size_t p_begin, size_t p_end) {
+            for (size_t p = p_begin; p < p_end; ++p) {
+                auto part_begin = order.begin() + partition_begin[p];
+                auto part_end = order.begin() + partition_begin[p + 1];
+                std::sort(part_begin, part_end, [&hashes](size_t lhs, size_t rhs) {
+                    return hashes[lhs] != hashes[rhs] ? hashes[lhs] < hashes[rhs] : lhs < rhs;
+                });
+                std::vector<size_t> kept;
+                for (auto group = part_begin; group != part_end;) {
+                    auto group_end = group;
+                    while (group_end != part_end && hashes[*group_end] == hashes[*group])
+                        ++group_end;
+                    kept.clear();
+                    for (auto candidate = group; candidate != group_end; ++candidate) {
+                        auto match = std::find_if(kept.begin(), kept.end(), [&](size_t index) {
+                            return key_equal_(first[index].first, first[*candidate].first);
+                        });
+                        if (match != kept.end())
+                            keep[*candidate] = 0;
+                        else
+                            kept.push_back(*candidate);
+                    }
+                    group = group_end;
+                }
+            }
+        });
+
+        size_t longest_chain = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (!keep[i])
+                continue;
+            storage_.emplace_back(std::in_place, first[i]);
+            bucket& chain = table_[buckets[i]];
+            try {
+                chain.emplace_back(std::prev(storage_.end()), hashes[i]);
+            } catch (...) {
+                storage_.pop_back();
+                throw;
+            }
+            link_entry(std::prev(chain.end()));
+            ++num_elements_;
+            longest_chain = std::max(longest_chain, chain.size());
+        }
+        if (longest_chain > kMaxChainLength)
+            reseed();
+    }
+
+    template<class K>
+    const ValueType& checked_at(const K& key) const {
+        const_iterator iter = find(key);
+        if (iter == end())
+            throw std::out_of_range("no such element");
+        return iter->second;
     }
 
 
 public:
-    explicit HashMap(Hash hasher_obj = Hash()) : hasher_(hasher_obj) {
-        InitializeTable();
+    static constexpr float kDefaultMaxLoadFactor = 0.5;
+
+    explicit HashMap(Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual(), const Allocator& alloc = Allocator())
+        : HashMap(kInitialCapacity, hasher_obj, equal, alloc) {}
+
+    // Starts with at least 'bucket_count' buckets instead of the default number, so that a map whose size is known
+    // up front allocates its buckets once.
+    explicit HashMap(size_t bucket_count, Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual(),
+                     const Allocator& alloc = Allocator())
+        : storage_(alloc), hasher_(hasher_obj), key_equal_(equal), table_(rebind_alloc<bucket>(alloc)),
+          old_table_(rebind_alloc<bucket>(alloc)), spare_table_(rebind_alloc<bucket>(alloc)) {
+        InitializeTable(std::max(bucket_count, size_t(1)));
     }
 
-    // Constructors are implemented as a bunch of insertions.
+    // Constructors are implemented as a bunch of insertions, or as a parallel build for large random access ranges.
     template<typename _ForwardIterator>
-    HashMap(_ForwardIterator begin, _ForwardIterator end, Hash hasher_obj =
-    Hash()) : HashMap(hasher_obj){
-        for (auto it = begin; it != end; ++it) {
-            insert(*it);
-        }
+    HashMap(_ForwardIterator begin, _ForwardIterator end, Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual(),
+            const Allocator& alloc = Allocator()) : HashMap(hasher_obj, equal, alloc) {
+        insert_range(begin, end);
     }
 
     HashMap(std::initializer_list<std::pair<KeyType, ValueType>> list,
-            Hash hasher_obj = Hash()) : HashMap(list.begin(), list.end(), hasher_obj) {}
+            Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual(), const Allocator& alloc = Allocator())
+        : HashMap(list.begin(), list.end(), hasher_obj, equal, alloc) {}
+
+    // The copy keeps the iteration order and the bucket count of the source, see clone_from(). Its buckets are
+    // allocated once, right at the capacity of the source.
+    HashMap(const HashMap& other)
+        : storage_(std::allocator_traits<Allocator>::select_on_container_copy_construction(other.get_allocator())),
+          hasher_(other.hasher_), key_equal_(other.key_equal_), max_load_factor_(other.max_load_factor_),
+          min_load_factor_(other.min_load_factor_), table_(rebind_alloc<bucket>(storage_.get_allocator())),
+          incremental_rehash_(other.incremental_rehash_), old_table_(rebind_alloc<bucket>(storage_.get_allocator())),
+          spare_table_(rebind_alloc<bucket>(storage_.get_allocator())), seed_(other.seed_),
+          reseeded_capacity_(other.reseeded_capacity_) {
+        clone_from(other);
+    }
+
+    // Takes over the elements and the buckets of the source, which is left empty but usable. The source keeps no
+    // buckets until something is inserted into it, so the move allocates nothing and cannot throw.
+    HashMap(HashMap&& other) noexcept(std::is_nothrow_move_constructible<storage_type>::value &&
+                                      std::is_nothrow_copy_constructible<Hash>::value &&
+                                      std::is_nothrow_copy_constructible<KeyEqual>::value)
+        : storage_(std::move(other.storage_)), hasher_(other.hasher_), key_equal_(other.key_equal_),
+          max_load_factor_(other.max_load_factor_), min_load_factor_(other.min_load_factor_),
+          capacity_(other.capacity_), policy_(other.policy_), table_(std::move(other.table_)),
+          num_elements_(other.num_elements_), incremental_rehash_(other.incremental_rehash_),
+          old_table_(std::move(other.old_table_)), old_policy_(other.old_policy_),
+          spare_table_(std::move(other.spare_table_)), spare_capacity_(other.spare_capacity_), seed_(other.seed_),
+          reseeded_capacity_(other.reseeded_capacity_) {
+        other.release_table();
+    }
 
     // Check if table contains the key and do nothing if it does, or add it.
-    iterator insert(std::pair<KeyType, ValueType> obj) {
-        iterator iter = find(obj.first);
+    iterator insert(const std::pair<const KeyType, ValueType>& obj) {
+        return insert_pair(obj).first;
+    }
+
+    iterator insert(std::pair<const KeyType, ValueType>&& obj) {
+        return insert_pair(std::move(obj)).first;
+    }
+
+    template<class P, class = typename std::enable_if<
+        std::is_constructible<std::pair<const KeyType, ValueType>, P&&>::value>::type>
+    iterator insert(P&& obj) {
+        return emplace(std::forward<P>(obj)).first;
+    }
+
+    template<class InputIt>
+    void insert(InputIt first, InputIt last) {
+        insert_range(first, last);
+    }
+
+    // Builds the element from the arguments; if its key is already in the table, the element is destroyed.
+    template<class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        if constexpr (hash_map_detail::is_key_pair<KeyType, Args...>::value) {
+            return insert_pair(std::forward<Args>(args)...);
+        } else if constexpr (hash_map_detail::is_key_and_value<KeyType, Args...>::value) {
+            return try_emplace_key(std::forward<Args>(args)...);
+        } else {
+            return emplace_node(std::forward<Args>(args)...);
+        }
+    }
+
+    // Does nothing if the key is in the table, otherwise builds the value from the arguments.
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(const KeyType& key, Args&&... args) {
+        return try_emplace_key(key, std::forward<Args>(args)...);
+    }
+
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(KeyType&& key, Args&&... args) {
+        return try_emplace_key(std::move(key), std::forward<Args>(args)...);
+    }
+
+    template<class M>
+    std::pair<iterator, bool> insert_or_assign(const KeyType& key, M&& obj) {
+        return assign_key(key, std::forward<M>(obj));
+    }
+
+    template<class M>
+    std::pair<iterator, bool> insert_or_assign(KeyType&& key, M&& obj) {
+        return assign_key(std::move(key), std::forward<M>(obj));
+    }
+
+    void erase(const KeyType& to_delete) {
+        erase_key(to_delete);
+    }
+
+    template<class K, if_transparent<K> = 0>
+    void erase(const K& to_delete) {
+        erase_key(to_delete);
+    }
+
+    // Erases the element an iterator points to, without looking its key up, and returns the iterator to the next one.
+    iterator erase(const_iterator pos) {
+        return erase_at(pos);
+    }
+
+    iterator erase(iterator pos) {
+        return erase_at(pos);
+    }
+
+    iterator erase(const_iterator first, const_iterator last) {
+        while (first != last)
+            first = erase_at(first);
+        // Turns 'last' into an iterator without erasing anything.
+        return iterator(storage_.erase(last.base(), last.base()));
+    }
+
+    // Erases every element that pred(element) holds for and returns their number. The sweep goes over the chains, so
+    // nothing is hashed and no chain is searched.
+    template<class Predicate>
+    size_t erase_if(Predicate pred) {
+        size_t count = erase_from_chains(table_, 0, capacity_, pred);
+        if (rehashing())
+            count += erase_from_chains(old_table_, 0, old_table_.size(), pred);
+        num_elements_ -= count;
+        try_to_shrink();
+        return count;
+    }
+
+    // Takes the element out of the map without destroying it; the node is empty if there is no such key.
+    node_type extract(const KeyType& key) {
+        return extract_key(key);
+    }
+
+    template<class K, if_transparent<K> = 0>
+    node_type extract(const K& key) {
+        return extract_key(key);
+    }
+
+    // Links the element of the node in unless its key is in the table already, in which case the node is handed back.
+    insert_return_type insert(node_type&& node) {
+        if (node.empty())
+            return {end(), false, std::move(node)};
+
+        rehash_step();
+        size_t hash = ApplyHash(node.key());
+        iterator iter = find_in_bucket(node.key(), hash);
         if (iter != end())
-            return iter;
+            return {iter, false, std::move(node)};
 
-        add_to_storage(obj);
-        ++num_elements_;
-        try_to_rehash();
-        return std::prev(end());
+        size_t node_size = 1;
+        iter = adopt(node.element_, node.entry_, node.entry_.begin(), hash, node_size);
+        return {iter, true, std::move(node)};
     }
 
-    void erase(KeyType to_delete) {
-        int32_t hashed = ApplyHash(to_delete);
-        for (auto iter = table_[hashed].begin(); iter != table_[hashed].end(); ++iter) {
-            if ((*iter)->first == to_delete) {
-                storage_.erase(*iter);
-                table_[hashed].erase(iter);
-                --num_elements_;
-                return;
+    // Moves every element of 'source' whose key is not in this map over here; the others stay in 'source'.
+    // Elements are relinked rather than copied unless the allocators differ.
+    void merge(HashMap& source) {
+        if (this == &source)
+            return;
+
+        rehash_step();
+        auto take_chains = [this, &source](iterator_vector& chains, size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                bucket& chain = chains[i];
+                for (auto entry = chain.begin(); entry != chain.end();) {
+                    auto next = std::next(entry);
+                    size_t hash = ApplyHash(key_of(*entry->it));
+                    if (find_in_bucket(key_of(*entry->it), hash) == end())
+                        adopt(source.storage_, chain, entry, hash, source.num_elements_);
+                    entry = next;
+                }
             }
-        }
+        };
+        take_chains(source.table_, 0, source.capacity_);
+        take_chains(source.old_table_, 0, source.old_table_.size());
+        source.try_to_shrink();
+    }
+
+    void merge(HashMap&& source) {
+        merge(source);
+    }
 
+    // Moves the element to the start or to the end of the iteration order. The nodes are relinked, so this takes
+    // constant time and all iterators stay valid.
+    void move_to_front(const_iterator pos) {
+        storage_.splice(storage_.begin(), storage_, pos.base());
+    }
+
+    void move_to_back(const_iterator pos) {
+        storage_.splice(storage_.end(), storage_, pos.base());
     }
 
     // Is required for internal tests.
@@ -109,63 +1425,300 @@ public:
         if (this == &other)
             return *this;
 
-        clear();
+        release_table();
         hasher_ = other.hash_function();
-        InitializeTable(other.capacity_);
-        for (auto &el : other) {
-            insert(el);
-        }
+        key_equal_ = other.key_equal_;
+        max_load_factor_ = other.max_load_factor_;
+        min_load_factor_ = other.min_load_factor_;
+        incremental_rehash_ = other.incremental_rehash_;
+        seed_ = other.seed_;
+        reseeded_capacity_ = other.reseeded_capacity_;
+        clone_from(other);
         return *this;
     }
 
-    iterator find(KeyType key) {
-        int32_t hashed = ApplyHash(key);
-        for (auto &el : table_[hashed]) {
-            if (el->first == key)
-                return iterator(el);
+    // Takes over the elements and the buckets when the allocator allows it; otherwise the elements are moved one by
+    // one into nodes of this map's allocator. The source is left empty, without buckets, as after the move
+    // constructor. Only the fallback allocates, so the assignment cannot throw when the allocator propagates or is
+    // always equal.
+    HashMap& operator= (HashMap&& other) noexcept(
+        (std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value ||
+         std::allocator_traits<Allocator>::is_always_equal::value) &&
+        std::is_nothrow_copy_assignable<Hash>::value && std::is_nothrow_copy_assignable<KeyEqual>::value) {
+        if (this == &other)
+            return *this;
+
+        hasher_ = other.hasher_;
+        key_equal_ = other.key_equal_;
+        max_load_factor_ = other.max_load_factor_;
+        min_load_factor_ = other.min_load_factor_;
+        incremental_rehash_ = other.incremental_rehash_;
+        seed_ = other.seed_;
+        reseeded_capacity_ = other.reseeded_capacity_;
+        constexpr bool propagate = std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value;
+        if (propagate || get_allocator() == other.get_allocator()) {
+            // Handing the list nodes over keeps all the iterators the buckets hold valid.
+            if constexpr (propagate) {
+                storage_ = std::move(other.storage_);
+                table_ = std::move(other.table_);
+                old_table_ = std::move(other.old_table_);
+                spare_table_ = std::move(other.spare_table_);
+            } else {
+                // The allocators are equal, so swapping moves the nodes without assigning any element.
+                storage_.swap(other.storage_);
+                table_.swap(other.table_);
+                old_table_.swap(other.old_table_);
+                spare_table_.swap(other.spare_table_);
+            }
+            capacity_ = other.capacity_;
+            policy_ = other.policy_;
+            num_elements_ = other.num_elements_;
+            old_policy_ = other.old_policy_;
+            spare_capacity_ = other.spare_capacity_;
+        } else {
+            clear();
+            reserve(other.size());
+            // The elements of 'other' are valid for this map, so they are appended without being looked up. That also
+            // keeps the equal keys of a HashMultiMap and works for the bare keys of a HashSet.
+            for (auto &el : other)
+                add_to_storage(ApplyHash(key_of(el)), std::move(el));
         }
+        other.release_table();
+        return *this;
+    }
 
-        return end();
+    // Exchanges the contents in constant time; allocators are exchanged as std::list::swap does.
+    void swap(HashMap& other) noexcept {
+        storage_.swap(other.storage_);
+        std::swap(hasher_, other.hasher_);
+        std::swap(key_equal_, other.key_equal_);
+        std::swap(max_load_factor_, other.max_load_factor_);
+        std::swap(min_load_factor_, other.min_load_factor_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(policy_, other.policy_);
+        table_.swap(other.table_);
+        std::swap(num_elements_, other.num_elements_);
+        std::swap(incremental_rehash_, other.incremental_rehash_);
+        old_table_.swap(other.old_table_);
+        std::swap(old_policy_, other.old_policy_);
+        spare_table_.swap(other.spare_table_);
+        std::swap(spare_capacity_, other.spare_capacity_);
+        std::swap(seed_, other.seed_);
+        std::swap(reseeded_capacity_, other.reseeded_capacity_);
     }
 
-    const_iterator find(KeyType key) const {
-        int32_t hashed = ApplyHash(key);
-        for (auto &el : table_[hashed]) {
-            if (el->first == key)
-                return el;
-        }
+    iterator find(const KeyType& key) {
+        rehash_step();
+        return lookup(key, ApplyHash(key));
+    }
 
-        return end();
+    const_iterator find(const KeyType& key) const {
+        return lookup(key, ApplyHash(key));
     }
 
-    ValueType& operator[](KeyType key) {
-        auto iter = find(key);
-        if (iter == end()) {
-            // Insert default value if an element was not found.
-            iter = insert({key, ValueType()});
-        }
-        return iter->second;
+    template<class K, if_transparent<K> = 0>
+    iterator find(const K& key) {
+        rehash_step();
+        return lookup(key, ApplyHash(key));
     }
 
-    const ValueType& at(KeyType key) const {
-        const_iterator iter = find(key);
-        if (iter == end())
-            throw std::out_of_range("no such element");
-        return iter->second;
+    template<class K, if_transparent<K> = 0>
+    const_iterator find(const K& key) const {
+        return lookup(key, ApplyHash(key));
+    }
+
+    // Writes the result of find for every key of the forward range [first, last) to out.
+    template<class ForwardIt, class OutputIt>
+    OutputIt find_batch(ForwardIt first, ForwardIt last, OutputIt out) {
+        rehash_step();
+        lookup_batch(first, last, [&out](iterator iter) { *out++ = iter; });
+        return out;
+    }
+
+    template<class ForwardIt, class OutputIt>
+    OutputIt find_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+        // The lookup itself modifies nothing.
+        const_cast<HashMap*>(this)->lookup_batch(first, last, [&out](iterator iter) { *out++ = const_iterator(iter); });
+        return out;
+    }
+
+    // Writes whether the table contains it for every key of the forward range [first, last) to out.
+    template<class ForwardIt, class OutputIt>
+    OutputIt contains_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+        iterator end_iter = const_cast<HashMap*>(this)->end();
+        const_cast<HashMap*>(this)->lookup_batch(first, last, [&out, end_iter](iterator iter) {
+            *out++ = iter != end_iter;
+        });
+        return out;
     }
 
+    // Insert default value if an element was not found.
+    ValueType& operator[](const KeyType& key) {
+        return try_emplace_key(key).first->second;
+    }
+
+    ValueType& operator[](KeyType&& key) {
+        return try_emplace_key(std::move(key)).first->second;
+    }
+
+    // The key is turned into a KeyType only if it has to be inserted.
+    template<class K, if_transparent<K> = 0>
+    ValueType& operator[](const K& key) {
+        return try_emplace_key(key).first->second;
+    }
+
+    const ValueType& at(const KeyType& key) const {
+        return checked_at(key);
+    }
+
+    template<class K, if_transparent<K> = 0>
+    const ValueType& at(const K& key) const {
+        return checked_at(key);
+    }
+
+    // Destroys the elements one by one, in time linear in size(), and goes back to the initial capacity. Elements
+    // without a destructor in an arena of their own are dropped at once instead, see drop_nodes().
     void clear() {
-        storage_.clear();
-        table_.clear();
+        if (!drop_nodes()) {
+            storage_.clear();
+            table_.clear();
+        }
+        old_table_ = iterator_vector(get_allocator());
         InitializeTable();
         num_elements_ = 0;
     }
 
+    // Writes the elements to a snapshot file that load() and MappedHashMap can read. Needs trivially copyable keys
+    // and values, and outside of this process the hasher has to give the same hashes.
+    void save(const std::string& path) const {
+        snapshot_detail::write<KeyType, ValueType>(path, begin(), end(), num_elements_, hasher_);
+    }
+
+    // Replaces the contents with the elements of a snapshot file written by save().
+    void load(const std::string& path) {
+        auto records = snapshot_detail::read<KeyType, ValueType>(path);
+        clear();
+        reserve(records.size());
+        for (auto &record : records)
+            try_emplace(record.first, record.second);
+    }
+
+    // Switches incremental rehashing on or off; switching it off completes a rehash in progress.
+    void set_incremental_rehash(bool enabled) {
+        incremental_rehash_ = enabled;
+        if (!enabled && rehashing())
+            move_old_buckets(old_table_.size());
+    }
+
+    bool incremental_rehash() const {
+        return incremental_rehash_;
+    }
+
+    size_t bucket_count() const {
+        return capacity_;
+    }
+
+    float load_factor() const {
+        return capacity_ != 0 ? static_cast<float>(num_elements_) / capacity_ : 0;
+    }
+
+    float max_load_factor() const {
+        return max_load_factor_;
+    }
+
+    void max_load_factor(float ml) {
+        if (!(ml > 0))
+            throw std::invalid_argument("max load factor must be positive");
+        max_load_factor_ = ml;
+        // A threshold that does not fit below the new maximum would make the table oscillate, so it is turned off.
+        if (min_load_factor_ >= ml / kGrowthFactor)
+            min_load_factor_ = 0;
+        if (num_elements_ > static_cast<double>(capacity_) * max_load_factor_)
+            rehash(0);
+    }
+
+    float min_load_factor() const {
+        return min_load_factor_;
+    }
+
+    // Makes erase shrink the table once the load factor falls below 'ml'; zero, the default, turns that off.
+    // The threshold has to stay below max_load_factor() / 2, so that a table that has just grown or shrunk is not
+    // resized right back.
+    void min_load_factor(float ml) {
+        if (!(ml >= 0 && ml < max_load_factor_ / kGrowthFactor))
+            throw std::invalid_argument("min load factor must be below half of the max load factor");
+        min_load_factor_ = ml;
+    }
+
+    // Gives back the memory of the buckets the current size does not need.
+    void shrink_to_fit() {
+        rehash(0);
+    }
+
+    // Sets the number of buckets to at least 'count', or to as many as the current size needs; may shrink the table.
+    // A table that has that number of buckets already is not rebuilt; only a rehash in progress is completed.
+    void rehash(size_t count) {
+        size_t capacity = std::max(min_capacity_for(num_elements_), count);
+        if (BucketPolicy::round_capacity(capacity) == capacity_) {
+            if (rehashing())
+                move_old_buckets(old_table_.size());
+            return;
+        }
+        start_rehash(capacity, false);
+    }
+
+    // Prepares the table for 'count' elements, so that inserting them does not cause a rehash.
+    void reserve(size_t count) {
+        rehash(min_capacity_for(count));
+    }
+
+    // Walks the whole table, so it takes time linear in bucket_count().
+    HashMapStats stats() const {
+        HashMapStats result;
+        auto count_chain = [&result](const bucket& chain) {
+            size_t length = chain.size();
+            if (length >= result.chain_lengths.size())
+                result.chain_lengths.resize(length + 1);
+            ++result.chain_lengths[length];
+        };
+        for (auto &chain : table_)
+            count_chain(chain);
+        for (auto &chain : old_table_)
+            count_chain(chain);
+        result.max_chain_length = result.chain_lengths.empty() ? 0 : result.chain_lengths.size() - 1;
+
+        // A list node holds two links besides its value.
+        size_t node_overhead = 2 * sizeof(void*);
+        result.bytes_allocated = num_elements_ * (sizeof(stored_element) + node_overhead) +
+                                 num_elements_ * (sizeof(bucket_entry) + node_overhead) +
+                                 (table_.capacity() + old_table_.capacity() + spare_table_.capacity()) *
+                                     sizeof(bucket);
+#if HASH_MAP_ENABLE_STATS
+        result.rehash_count = stats_.rehashes.load();
+        result.rehash_time = std::chrono::nanoseconds(stats_.rehash_nanoseconds.load());
+        result.find_hits = stats_.find_hits.load();
+        result.find_misses = stats_.find_misses.load();
+#endif
+        return result;
+    }
+
+    void reset_stats() {
+        stats_ = hash_map_detail::StatCounters<hash_map_detail::kStatsEnabled>();
+    }
+
     Hash hash_function() const {
         return hasher_;
     }
 
-    int32_t size() const {
+    KeyEqual key_eq() const {
+        return key_equal_;
+    }
+
+    allocator_type get_allocator() const {
+        return storage_.get_allocator();
+    }
+
+    size_t size() const {
         return num_elements_;
     }
 
@@ -180,13 +1733,13 @@ public:
         return iterator(storage_.end());
     }
     const_iterator begin() const {
-        return storage_.begin();
+        return const_iterator(storage_.begin());
     }
     const_iterator end() const {
-        return storage_.end();
+        return const_iterator(storage_.end());
     }
 
     ~HashMap() {
-        clear();
+        release_table();
     }
 };
\ No newline at end of file
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "hash_map.h"
+
+/**
+ * Map that may hold several values for one key, on the engine of HashMap: the same chains, rehashing (incremental
+ * too), seeding, allocators and bucket policies. Every value is an element of its own, a 'key, value' pair in a node
+ * of storage_, so a key with many values takes no separate container and no extra allocation.
+ * Elements with equal keys are kept next to each other, in the order of the chains: a new one goes right after the
+ * first element with its key, and equal_range() returns them as one range of storage_. Equal keys share a chain, so
+ * the chain of a key with many values is long, but lookups of that key stop at its first element.
+ */
+
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class KeyEqual = std::equal_to<KeyType>,
+         class Allocator = std::allocator<std::pair<const KeyType, ValueType>>,
+         bool CacheHash = !hash_map_detail::is_cheap_hash<KeyType, Hash>::value,
+         class BucketPolicy = PowerOfTwoBucketPolicy>
+class HashMultiMap {
+    using engine_type = HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator, CacheHash, BucketPolicy>;
+
+public:
+    using value_type = std::pair<const KeyType, ValueType>;
+    using iterator = typename engine_type::iterator;
+    using const_iterator = typename engine_type::const_iterator;
+    using allocator_type = Allocator;
+
+private:
+    engine_type table_;
+
+public:
+    explicit HashMultiMap(Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual(),
+                          const Allocator& alloc = Allocator())
+        : table_(hasher_obj, equal, alloc) {}
+
+    template<typename _ForwardIterator>
+    HashMultiMap(_ForwardIterator begin, _ForwardIterator end, Hash hasher_obj = Hash(),
+                 const KeyEqual& equal = KeyEqual(), const Allocator& alloc = Allocator())
+        : HashMultiMap(hasher_obj, equal, alloc) {
+        insert(begin, end);
+    }
+
+    HashMultiMap(std::initializer_list<std::pair<KeyType, ValueType>> list, Hash hasher_obj = Hash(),
+                 const KeyEqual& equal = KeyEqual(), const Allocator& alloc = Allocator())
+        : HashMultiMap(list.begin(), list.end(), hasher_obj, equal, alloc) {}
+
+    // Adds the element whether or not its key is in the map already.
+    iterator insert(const value_type& obj) {
+        return table_.emplace_equal(obj);
+    }
+
+    iterator insert(value_type&& obj) {
+        return table_.emplace_equal(std::move(obj));
+    }
+
+    template<class P, class = typename std::enable_if<std::is_constructible<value_type, P&&>::value>::type>
+    iterator insert(P&& obj) {
+        return table_.emplace_equal(std::forward<P>(obj));
+    }
+
+    template<class InputIt>
+    void insert(InputIt first, InputIt last) {
+        using category = typename std::iterator_traits<InputIt>::iterator_category;
+        if constexpr (std::is_base_of<std::forward_iterator_tag, category>::value)
+            table_.reserve_more(static_cast<size_t>(std::distance(first, last)));
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+    template<class... Args>
+    iterator emplace(Args&&... args) {
+        return table_.emplace_equal(std::forward<Args>(args)...);
+    }
+
+    // Erases all the elements with the key and returns their number.
+    size_t erase(const KeyType& key) {
+        auto range = table_.equal_range_key(key);
+        size_t count = static_cast<size_t>(std::distance(range.first, range.second));
+        table_.erase(range.first, range.second);
+        return count;
+    }
+
+    iterator erase(const_iterator pos) {
+        return table_.erase(pos);
+    }
+
+    iterator erase(iterator pos) {
+        return table_.erase(pos);
+    }
+
+    iterator erase(const_iterator first, const_iterator last) {
+        return table_.erase(first, last);
+    }
+
+    template<class Predicate>
+    size_t erase_if(Predicate pred) {
+        return table_.erase_if(pred);
+    }
+
+    // The first element with the key.
+    iterator find(const KeyType& key) {
+        return table_.find(key);
+    }
+
+    const_iterator find(const KeyType& key) const {
+        return table_.find(key);
+    }
+
+    std::pair<iterator, iterator> equal_range(const KeyType& key) {
+        return table_.equal_range_key(key);
+    }
+
+    std::pair<const_iterator, const_iterator> equal_range(const KeyType& key) const {
+        // The lookup itself modifies nothing.
+        return const_cast<engine_type&>(table_).equal_range_key(key);
+    }
+
+    size_t count(const KeyType& key) const {
+        auto range = equal_range(key);
+        return static_cast<size_t>(std::distance(range.first, range.second));
+    }
+
+    bool contains(const KeyType& key) const {
+        return find(key) != end();
+    }
+
+    void clear() {
+        table_.clear();
+    }
+
+    void reserve(size_t count) {
+        table_.reserve(count);
+    }
+
+    void rehash(size_t count) {
+        table_.rehash(count);
+    }
+
+    void swap(HashMultiMap& other) noexcept {
+        table_.swap(other.table_);
+    }
+
+    void set_incremental_rehash(bool enabled) {
+        table_.set_incremental_rehash(enabled);
+    }
+
+    size_t bucket_count() const {
+        return table_.bucket_count();
+    }
+
+    float load_factor() const {
+        return table_.load_factor();
+    }
+
+    float max_load_factor() const {
+        return table_.max_load_factor();
+    }
+
+    void max_load_factor(float ml) {
+        table_.max_load_factor(ml);
+    }
+
+    HashMapStats stats() const {
+        return table_.stats();
+    }
+
+    Hash hash_function() const {
+        return table_.hash_function();
+    }
+
+    KeyEqual key_eq() const {
+        return table_.key_eq();
+    }
+
+    allocator_type get_allocator() const {
+        return table_.get_allocator();
+    }
+
+    size_t size() const {
+        return table_.size();
+    }
+
+    bool empty() const {
+        return table_.empty();
+    }
+
+    iterator begin() {
+        return table_.begin();
+    }
+    iterator end() {
+        return table_.end();
+    }
+    const_iterator begin() const {
+        return table_.begin();
+    }
+    const_iterator end() const {
+        return table_.end();
+    }
+};
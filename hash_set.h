@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "hash_map.h"
+
+/**
+ * Set of unique keys on the engine of HashMap: the same chains, rehashing (incremental too), seeding, allocators and
+ * bucket policies, but the nodes of storage_ hold the bare key, with no value next to it.
+ * Keys cannot be changed through the iterators, so iterator and const_iterator are the same type.
+ */
+
+template<class KeyType, class Hash = std::hash<KeyType>, class KeyEqual = std::equal_to<KeyType>,
+         class Allocator = std::allocator<KeyType>,
+         bool CacheHash = !hash_map_detail::is_cheap_hash<KeyType, Hash>::value,
+         class BucketPolicy = PowerOfTwoBucketPolicy>
+class HashSet {
+    using engine_type = HashMap<KeyType, hash_map_detail::NoValue, Hash, KeyEqual, Allocator, CacheHash, BucketPolicy,
+                                hash_map_detail::KeyElement<KeyType>>;
+
+public:
+    using value_type = KeyType;
+    using const_iterator = typename engine_type::const_iterator;
+    using iterator = const_iterator;
+    using allocator_type = Allocator;
+
+private:
+    engine_type table_;
+
+    template<class K>
+    using if_transparent = typename std::enable_if<hash_map_detail::is_transparent<Hash, KeyEqual>::value &&
+                                                   !std::is_convertible<const K&, const_iterator>::value, int>::type;
+
+public:
+    explicit HashSet(Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual(), const Allocator& alloc = Allocator())
+        : table_(hasher_obj, equal, alloc) {}
+
+    template<typename _ForwardIterator>
+    HashSet(_ForwardIterator begin, _ForwardIterator end, Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual(),
+            const Allocator& alloc = Allocator()) : HashSet(hasher_obj, equal, alloc) {
+        insert(begin, end);
+    }
+
+    HashSet(std::initializer_list<KeyType> list, Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual(),
+            const Allocator& alloc = Allocator())
+        : HashSet(list.begin(), list.end(), hasher_obj, equal, alloc) {}
+
+    // Check if table contains the key and do nothing if it does, or add it.
+    std::pair<iterator, bool> insert(const KeyType& key) {
+        return table_.emplace_unique(key, key);
+    }
+
+    std::pair<iterator, bool> insert(KeyType&& key) {
+        return table_.emplace_unique(key, std::move(key));
+    }
+
+    template<class InputIt>
+    void insert(InputIt first, InputIt last) {
+        using category = typename std::iterator_traits<InputIt>::iterator_category;
+        if constexpr (std::is_base_of<std::forward_iterator_tag, category>::value)
+            table_.reserve_more(static_cast<size_t>(std::distance(first, last)));
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+    // Builds the key from the arguments; it is destroyed if it is in the set already.
+    template<class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        if constexpr (sizeof...(Args) == 1 && (std::is_same<typename std::decay<Args>::type, KeyType>::value && ...)) {
+            return insert(std::forward<Args>(args)...);
+        } else {
+            return table_.emplace_node(std::forward<Args>(args)...);
+        }
+    }
+
+    void erase(const KeyType& key) {
+        table_.erase(key);
+    }
+
+    template<class K, if_transparent<K> = 0>
+    void erase(const K& key) {
+        table_.erase(key);
+    }
+
+    iterator erase(const_iterator pos) {
+        return table_.erase(pos);
+    }
+
+    iterator erase(const_iterator first, const_iterator last) {
+        return table_.erase(first, last);
+    }
+
+    template<class Predicate>
+    size_t erase_if(Predicate pred) {
+        return table_.erase_if([&pred](const KeyType& key) { return pred(key); });
+    }
+
+    const_iterator find(const KeyType& key) const {
+        return table_.find(key);
+    }
+
+    template<class K, if_transparent<K> = 0>
+    const_iterator find(const K& key) const {
+        return table_.find(key);
+    }
+
+    bool contains(const KeyType& key) const {
+        return find(key) != end();
+    }
+
+    template<class K, if_transparent<K> = 0>
+    bool contains(const K& key) const {
+        return find(key) != end();
+    }
+
+    size_t count(const KeyType& key) const {
+        return contains(key) ? 1 : 0;
+    }
+
+    void clear() {
+        table_.clear();
+    }
+
+    void reserve(size_t count) {
+        table_.reserve(count);
+    }
+
+    void rehash(size_t count) {
+        table_.rehash(count);
+    }
+
+    void swap(HashSet& other) noexcept {
+        table_.swap(other.table_);
+    }
+
+    void set_incremental_rehash(bool enabled) {
+        table_.set_incremental_rehash(enabled);
+    }
+
+    size_t bucket_count() const {
+        return table_.bucket_count();
+    }
+
+    float load_factor() const {
+        return table_.load_factor();
+    }
+
+    float max_load_factor() const {
+        return table_.max_load_factor();
+    }
+
+    void max_load_factor(float ml) {
+        table_.max_load_factor(ml);
+    }
+
+    HashMapStats stats() const {
+        return table_.stats();
+    }
+
+    Hash hash_function() const {
+        return table_.hash_function();
+    }
+
+    KeyEqual key_eq() const {
+        return table_.key_eq();
+    }
+
+    allocator_type get_allocator() const {
+        return table_.get_allocator();
+    }
+
+    size_t size() const {
+        return table_.size();
+    }
+
+    bool empty() const {
+        return table_.empty();
+    }
+
+    const_iterator begin() const {
+        return table_.begin();
+    }
+    const_iterator end() const {
+        return table_.end();
+    }
+};
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+#include "hash_map.h"
+
+/**
+ * Bounded cache on top of HashMap. The order of the elements in storage_ doubles as the recency order: the most
+ * recently used element is first and the least recently used one is last. find moves the element it hits to the
+ * front by relinking its node, which takes constant time and no allocation, and inserting a new key into a full
+ * cache erases the last element first.
+ * Elements may also get a time to live, for the whole cache or per insertion. Expired elements are not looked for:
+ * a lookup that finds one erases it and reports a miss, and until then it still counts in size(). purge_expired()
+ * erases all of them at once. A zero time to live, the default, means that elements never expire.
+ * Clock is only a parameter so that expiry can be tested without waiting.
+ */
+
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class KeyEqual = std::equal_to<KeyType>,
+         class Clock = std::chrono::steady_clock>
+class LruHashMap {
+public:
+    using duration = typename Clock::duration;
+    using time_point = typename Clock::time_point;
+
+private:
+    struct Entry {
+        ValueType value;
+        time_point expires;
+
+        template<class M>
+        Entry(M&& obj, time_point expiry) : value(std::forward<M>(obj)), expires(expiry) {}
+    };
+
+    using map_type = HashMap<KeyType, Entry, Hash, KeyEqual>;
+
+    map_type map_;
+    size_t max_size_;
+    duration ttl_;
+
+    static time_point expiry(duration ttl) {
+        return ttl == duration::zero() ? time_point::max() : Clock::now() + ttl;
+    }
+
+    static bool expired(const Entry& entry, time_point now) {
+        return entry.expires <= now;
+    }
+
+    // Drops the least recently used elements until the cache fits into max_size_.
+    void evict() {
+        while (map_.size() > max_size_)
+            map_.erase(std::prev(map_.end()));
+    }
+
+    // A new key in a full cache first evicts the least recently used element, so that the insertion never grows the
+    // table for an element that would be dropped right after.
+    template<class K, class M>
+    ValueType& assign_key(K&& key, M&& obj, duration ttl) {
+        auto iter = map_.find(key);
+        if (iter != map_.end()) {
+            iter->second.value = std::forward<M>(obj);
+            iter->second.expires = expiry(ttl);
+        } else {
+            if (map_.size() >= max_size_)
+                map_.erase(std::prev(map_.end()));
+            iter = map_.try_emplace(std::forward<K>(key), std::forward<M>(obj), expiry(ttl)).first;
+        }
+        map_.move_to_front(iter);
+        return iter->second.value;
+    }
+
+public:
+    explicit LruHashMap(size_t max_size, duration ttl = duration::zero(), Hash hasher_obj = Hash(),
+                        const KeyEqual& equal = KeyEqual())
+        : map_(hasher_obj, equal), max_size_(max_size), ttl_(ttl) {
+        if (max_size == 0)
+            throw std::invalid_argument("max size must be positive");
+        if (ttl < duration::zero())
+            throw std::invalid_argument("time to live must not be negative");
+    }
+
+    LruHashMap(const LruHashMap& other) : map_(other.map_), max_size_(other.max_size_), ttl_(other.ttl_) {}
+
+    LruHashMap(LruHashMap&& other) = default;
+
+    LruHashMap& operator= (const LruHashMap& other) {
+
+        //Anti-self-assignment.
+        if (this == &other)
+            return *this;
+
+        LruHashMap copy(other);
+        swap(copy);
+        return *this;
+    }
+
+    LruHashMap& operator= (LruHashMap&& other) = default;
+
+    // Inserts the element or replaces its value, makes it the most recently used one and restarts its time to live.
+    template<class M>
+    ValueType& insert_or_assign(const KeyType& key, M&& obj) {
+        return assign_key(key, std::forward<M>(obj), ttl_);
+    }
+
+    template<class M>
+    ValueType& insert_or_assign(KeyType&& key, M&& obj) {
+        return assign_key(std::move(key), std::forward<M>(obj), ttl_);
+    }
+
+    // The same with a time to live for this element alone.
+    template<class M>
+    ValueType& insert_or_assign(const KeyType& key, M&& obj, duration ttl) {
+        return assign_key(key, std::forward<M>(obj), ttl);
+    }
+
+    template<class M>
+    ValueType& insert_or_assign(KeyType&& key, M&& obj, duration ttl) {
+        return assign_key(std::move(key), std::forward<M>(obj), ttl);
+    }
+
+    // Returns the value, or nullptr if there is none or it has expired. A hit becomes the most recently used element.
+    ValueType* find(const KeyType& key) {
+        auto iter = map_.find(key);
+        if (iter == map_.end())
+            return nullptr;
+        if (expired(iter->second, Clock::now())) {
+            map_.erase(iter);
+            return nullptr;
+        }
+        map_.move_to_front(iter);
+        return &iter->second.value;
+    }
+
+    // Looks the value up without making it more recent and without erasing it if it has expired.
+    const ValueType* peek(const KeyType& key) const {
+        auto iter = map_.find(key);
+        if (iter == map_.end() || expired(iter->second, Clock::now()))
+            return nullptr;
+        return &iter->second.value;
+    }
+
+    bool contains(const KeyType& key) const {
+        return peek(key) != nullptr;
+    }
+
+    void erase(const KeyType& to_delete) {
+        map_.erase(to_delete);
+    }
+
+    // Erases every expired element and returns how many there were.
+    size_t purge_expired() {
+        time_point now = Clock::now();
+        return map_.erase_if([now](const auto& el) { return expired(el.second, now); });
+    }
+
+    // Calls fn(key, value) for every element that has not expired, from the most to the least recently used one.
+    template<class F>
+    void for_each(F&& fn) const {
+        time_point now = Clock::now();
+        for (auto &el : map_) {
+            if (!expired(el.second, now))
+                fn(el.first, el.second.value);
+        }
+    }
+
+    void clear() {
+        map_.clear();
+    }
+
+    void swap(LruHashMap& other) noexcept {
+        map_.swap(other.map_);
+        std::swap(max_size_, other.max_size_);
+        std::swap(ttl_, other.ttl_);
+    }
+
+    // Lowering the bound evicts the least recently used elements right away.
+    void max_size(size_t count) {
+        if (count == 0)
+            throw std::invalid_argument("max size must be positive");
+        max_size_ = count;
+        evict();
+    }
+
+    size_t max_size() const {
+        return max_size_;
+    }
+
+    duration ttl() const {
+        return ttl_;
+    }
+
+    // Counts the expired elements that have not been erased yet.
+    size_t size() const {
+        return map_.size();
+    }
+
+    bool empty() const {
+        return map_.empty();
+    }
+
+    Hash hash_function() const {
+        return map_.hash_function();
+    }
+
+    KeyEqual key_eq() const {
+        return map_.key_eq();
+    }
+};
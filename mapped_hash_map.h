@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bucket_policy.h"
+#include "snapshot.h"
+
+/**
+ * Read-only map served straight from a snapshot file written by HashMap::save.
+ * The file is mapped with mmap and lookups read the mapped pages, so opening does not deserialize anything and
+ * processes that map the same snapshot share one copy in the page cache. Only the pages that lookups touch are read.
+ * The bucket offsets are checked on every lookup instead of all at once, so a damaged file cannot make a lookup read
+ * outside of the mapping, and opening stays independent of the size of the snapshot.
+ * A seeded hasher takes the seed stored in the snapshot, whatever seed it was constructed with.
+ * Elements are snapshot records with the key in 'first' and the value in 'second', and iterators are plain pointers
+ * into the mapping. They stay valid as long as the map is alive.
+ */
+
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class KeyEqual = std::equal_to<KeyType> >
+class MappedHashMap {
+public:
+    using value_type = snapshot_detail::Record<KeyType, ValueType>;
+    using const_iterator = const value_type*;
+    using iterator = const_iterator;
+
+private:
+    Hash hasher_;
+    KeyEqual key_equal_;
+    void* mapping_ = nullptr;
+    size_t mapping_size_ = 0;
+    const uint64_t* offsets_ = nullptr;
+    const value_type* records_ = nullptr;
+    uint64_t num_elements_ = 0;
+    PowerOfTwoBucketPolicy policy_;
+
+    // Lookups by another key type K are allowed if both Hash and KeyEqual are transparent.
+    template<class K, class = void>
+    struct transparent : std::false_type {};
+
+    template<class K>
+    struct transparent<K, std::void_t<typename Hash::is_transparent, typename KeyEqual::is_transparent>>
+        : std::true_type {};
+
+    template<class K>
+    using if_transparent = typename std::enable_if<transparent<K>::value, int>::type;
+
+    template<class K>
+    const_iterator find_key(const K& key) const {
+        if (num_elements_ == 0)
+            return end();
+        size_t bucket_id = policy_.index(hasher_(key));
+        uint64_t first = offsets_[bucket_id];
+        uint64_t last = offsets_[bucket_id + 1];
+        if (last > num_elements_ || first > last)
+            return end();
+        for (const value_type* record = records_ + first; record != records_ + last; ++record) {
+            if (key_equal_(record->first, key))
+                return record;
+        }
+        return end();
+    }
+
+    template<class K>
+    const ValueType& checked_at(const K& key) const {
+        const_iterator iter = find_key(key);
+        if (iter == end())
+            throw std::out_of_range("no such element");
+        return iter->second;
+    }
+
+    void unmap() {
+        if (mapping_ != nullptr)
+            munmap(mapping_, mapping_size_);
+        mapping_ = nullptr;
+    }
+
+public:
+    explicit MappedHashMap(const std::string& path, Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual())
+        : hasher_(hasher_obj), key_equal_(equal) {
+        snapshot_detail::check_types<KeyType, ValueType>();
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw std::runtime_error("cannot open " + path);
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            throw std::runtime_error("cannot stat " + path);
+        }
+        mapping_size_ = static_cast<size_t>(info.st_size);
+        if (mapping_size_ < sizeof(snapshot_detail::Header)) {
+            close(fd);
+            throw std::runtime_error("not a hash map snapshot");
+        }
+        mapping_ = mmap(nullptr, mapping_size_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping_ == MAP_FAILED) {
+            mapping_ = nullptr;
+            throw std::runtime_error("cannot map " + path);
+        }
+
+        const char* base = static_cast<const char*>(mapping_);
+        const auto* header = reinterpret_cast<const snapshot_detail::Header*>(base);
+        try {
+            snapshot_detail::validate<KeyType, ValueType>(*header, mapping_size_);
+        } catch (...) {
+            unmap();
+            throw;
+        }
+        offsets_ = reinterpret_cast<const uint64_t*>(base + header->offsets_offset);
+        records_ = reinterpret_cast<const value_type*>(base + header->records_offset);
+        num_elements_ = header->size;
+        policy_.reset(header->bucket_count);
+        if constexpr (snapshot_detail::has_seed<Hash>::value)
+            hasher_.reseed(header->hash_seed);
+    }
+
+    MappedHashMap(const MappedHashMap&) = delete;
+    MappedHashMap& operator= (const MappedHashMap&) = delete;
+
+    MappedHashMap(MappedHashMap&& other) noexcept
+        : hasher_(std::move(other.hasher_)), key_equal_(std::move(other.key_equal_)), mapping_(other.mapping_),
+          mapping_size_(other.mapping_size_), offsets_(other.offsets_), records_(other.records_),
+          num_elements_(other.num_elements_), policy_(other.policy_) {
+        other.mapping_ = nullptr;
+        other.offsets_ = nullptr;
+        other.records_ = nullptr;
+        other.num_elements_ = 0;
+    }
+
+    const_iterator find(const KeyType& key) const {
+        return find_key(key);
+    }
+
+    template<class K, if_transparent<K> = 0>
+    const_iterator find(const K& key) const {
+        return find_key(key);
+    }
+
+    const ValueType& at(const KeyType& key) const {
+        return checked_at(key);
+    }
+
+    template<class K, if_transparent<K> = 0>
+    const ValueType& at(const K& key) const {
+        return checked_at(key);
+    }
+
+    size_t size() const {
+        return num_elements_;
+    }
+
+    bool empty() const {
+        return num_elements_ == 0;
+    }
+
+    Hash hash_function() const {
+        return hasher_;
+    }
+
+    const_iterator begin() const {
+        return records_;
+    }
+    const_iterator end() const {
+        return records_ + num_elements_;
+    }
+
+    ~MappedHashMap() {
+        unmap();
+    }
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+/**
+ * Page level memory for large maps: anonymous mappings that may be backed by huge pages and placed on chosen NUMA
+ * nodes. PoolAllocator takes its slabs and its large arrays from here when its arena is built with PageOptions.
+ * Huge pages cut the TLB misses of lookups that land all over a large table. kTransparentHuge asks the kernel to
+ * back a 2 MiB aligned mapping with transparent huge pages (madvise MADV_HUGEPAGE). kHuge2M and kHuge1G map
+ * pages from the reserved hugetlbfs pool (MAP_HUGETLB); when the pool has no free pages of that size, the mapping
+ * falls back to transparent huge pages.
+ * A mapping takes whole pages, so kHuge1G is only used for mappings of at least 1 GiB, e.g. the bucket array of a
+ * table with tens of millions of buckets. Smaller ones, like the slabs of PoolAllocator, get 2 MiB pages instead;
+ * otherwise every one of them would pin a whole gigabyte.
+ * The NUMA policy is applied with mbind before the pages are touched: kInterleave spreads the pages over the nodes
+ * in 'nodes', so that every socket sees the same average latency, and kBind keeps them on those nodes, e.g. on the
+ * node of the threads that use one shard of a ConcurrentHashMap. Zero 'nodes' means all nodes. The policy is a
+ * placement hint: on kernels or machines that do not support it the memory is used as it is.
+ */
+
+enum class PageSize {
+    kDefault,
+    kTransparentHuge,
+    kHuge2M,
+    kHuge1G,
+};
+
+enum class NumaPolicy {
+    kDefault,
+    kInterleave,
+    kBind,
+};
+
+struct PageOptions {
+    PageSize page_size = PageSize::kDefault;
+    NumaPolicy numa = NumaPolicy::kDefault;
+    // Bit i stands for NUMA node i.
+    uint64_t nodes = 0;
+
+    bool is_default() const {
+        return page_size == PageSize::kDefault && numa == NumaPolicy::kDefault;
+    }
+};
+
+namespace page_memory_detail {
+
+constexpr size_t kHugePage = size_t(2) << 20;
+constexpr size_t kGiantPage = size_t(1) << 30;
+// Values from linux/mman.h and linux/mempolicy.h, which not every libc exposes.
+constexpr int kHugeShift = 26;
+constexpr int kBindMode = 2;
+constexpr int kInterleaveMode = 3;
+
+inline size_t round_up(size_t bytes, size_t page) {
+    return (bytes + page - 1) / page * page;
+}
+
+inline void apply_numa_policy(void* memory, size_t bytes, const PageOptions& options) {
+#if defined(__linux__) && defined(SYS_mbind)
+    if (options.numa == NumaPolicy::kDefault)
+        return;
+    unsigned long mask = options.nodes != 0 ? static_cast<unsigned long>(options.nodes) : ~0ul;
+    int mode = options.numa == NumaPolicy::kBind ? kBindMode : kInterleaveMode;
+    // The kernel reads maxnode - 1 bits of the mask.
+    syscall(SYS_mbind, memory, bytes, mode, &mask, sizeof(mask) * 8 + 1, 0);
+#else
+    (void)memory;
+    (void)bytes;
+    (void)options;
+#endif
+}
+
+inline void* map_anonymous(size_t bytes, int extra_flags) {
+    void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+    return memory == MAP_FAILED ? nullptr : memory;
+}
+
+// Maps 'bytes', a multiple of kHugePage, at a kHugePage boundary and asks for transparent huge pages.
+inline void* map_transparent(size_t bytes) {
+    size_t span = bytes + kHugePage;
+    char* raw = static_cast<char*>(map_anonymous(span, 0));
+    if (raw == nullptr)
+        return nullptr;
+    char* aligned = reinterpret_cast<char*>(round_up(reinterpret_cast<uintptr_t>(raw), kHugePage));
+    if (aligned != raw)
+        munmap(raw, aligned - raw);
+    munmap(aligned + bytes, raw + span - (aligned + bytes));
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, bytes, MADV_HUGEPAGE);
+#endif
+    return aligned;
+}
+
+}  // namespace page_memory_detail
+
+// The largest page size of the mappings made with these options.
+inline size_t page_bytes(const PageOptions& options) {
+    switch (options.page_size) {
+        case PageSize::kTransparentHuge:
+        case PageSize::kHuge2M:
+            return page_memory_detail::kHugePage;
+        case PageSize::kHuge1G:
+            return page_memory_detail::kGiantPage;
+        default:
+            return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+}
+
+namespace page_memory_detail {
+
+// The page size a mapping of 'bytes' gets: 1 GiB pages only for mappings that fill at least one of them.
+inline PageSize page_size_for(size_t bytes, const PageOptions& options) {
+    if (options.page_size == PageSize::kHuge1G && bytes < kGiantPage)
+        return PageSize::kHuge2M;
+    return options.page_size;
+}
+
+}  // namespace page_memory_detail
+
+// The number of bytes map_pages actually maps for a request of 'bytes', a whole number of pages.
+inline size_t mapped_bytes(size_t bytes, const PageOptions& options) {
+    PageOptions pages = options;
+    pages.page_size = page_memory_detail::page_size_for(bytes, options);
+    return page_memory_detail::round_up(bytes, page_bytes(pages));
+}
+
+// Maps at least 'bytes' of zeroed memory; throws std::bad_alloc if the system has none left.
+inline void* map_pages(size_t bytes, const PageOptions& options) {
+    using namespace page_memory_detail;
+    PageSize page_size = page_size_for(bytes, options);
+    bytes = mapped_bytes(bytes, options);
+    void* memory = nullptr;
+    switch (page_size) {
+        case PageSize::kHuge2M:
+        case PageSize::kHuge1G: {
+#ifdef MAP_HUGETLB
+            int log_size = page_size == PageSize::kHuge2M ? 21 : 30;
+            memory = map_anonymous(bytes, MAP_HUGETLB | (log_size << kHugeShift));
+#endif
+            if (memory == nullptr)
+                memory = map_transparent(bytes);
+            break;
+        }
+        case PageSize::kTransparentHuge:
+            memory = map_transparent(bytes);
+            break;
+        default:
+            memory = map_anonymous(bytes, 0);
+    }
+    if (memory == nullptr)
+        throw std::bad_alloc();
+    apply_numa_policy(memory, bytes, options);
+    return memory;
+}
+
+// Gives back a mapping made by map_pages with the same size and options.
+inline void unmap_pages(void* memory, size_t bytes, const PageOptions& options) {
+    munmap(memory, mapped_bytes(bytes, options));
+}
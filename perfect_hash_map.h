@@ -0,0 +1,405 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "bucket_policy.h"
+
+/**
+ * Read-only maps over a key set that is known when the map is built, e.g. enum names, config keys or protocol fields.
+ * The keys are placed by hash and displace (CHD): they are split into small groups by their hash, and for every group,
+ * the largest first, the builder searches for a displacement that sends all of its keys into free slots. A lookup
+ * then hashes the key once, reads the displacement of its group and the slot it points to, and compares one key.
+ * There are no chains, no rehashing and no allocation after the build. The slots are at most 7/8 full, so the search
+ * stays short even for the last groups.
+ * FixedHashMap keeps everything in std::array and is built by a constexpr constructor, so a map declared constexpr is
+ * laid out by the compiler. This needs a hasher that can run at compile time; FixedHash is one. PerfectHashMap is
+ * the same table built at run time into vectors, for key sets too large to be compile time constants.
+ * Both are built from 'key, value' pairs with distinct keys, and keep them in the order they were given. Keys must
+ * also have distinct hashes, since no displacement can tell apart keys with equal hashes; building fails with
+ * std::invalid_argument otherwise, which in a constant expression is a compile error.
+ */
+
+// Hasher that can run at compile time. Strings are hashed by their characters with FNV-1a, integral and enum keys by
+// their value widened to 64 bits, so that transparent lookups by another integer type give the same hash.
+struct FixedHash {
+    using is_transparent = void;
+
+    constexpr size_t operator()(std::string_view str) const {
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (char c : str) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 0x100000001B3ull;
+        }
+        return static_cast<size_t>(hash);
+    }
+
+    template<class T, class = typename std::enable_if<std::is_integral<T>::value>::type>
+    constexpr size_t operator()(T value) const {
+        return static_cast<size_t>(static_cast<uint64_t>(value));
+    }
+
+    template<class T, class = typename std::enable_if<std::is_enum<T>::value>::type, class = void>
+    constexpr size_t operator()(T value) const {
+        return (*this)(static_cast<typename std::underlying_type<T>::type>(value));
+    }
+};
+
+namespace perfect_hash_detail {
+
+constexpr uint32_t kEmpty = UINT32_MAX;
+constexpr size_t kKeysPerGroup = 4;
+constexpr uint32_t kMaxDisplacement = 1u << 24;
+
+constexpr size_t round_up_power_of_two(size_t count) {
+    size_t power = 1;
+    while (power < count)
+        power *= 2;
+    return power;
+}
+
+constexpr size_t group_count(size_t size) {
+    return round_up_power_of_two(size / kKeysPerGroup);
+}
+
+// The smallest power of two that is at least 8/7 of the size.
+constexpr size_t slot_count(size_t size) {
+    return round_up_power_of_two(size + size / 7 + 1);
+}
+
+// The hash of the key, already mixed, so that both the group and the slot can be taken from its bits.
+template<class Hash, class K>
+constexpr size_t key_hash(const Hash& hasher, const K& key) {
+    return static_cast<size_t>(mix_hash(hasher(key)));
+}
+
+// The group is the upper half of the bits of the mixed hash, masked to the number of groups. The slot, see slot_of,
+// mixes the whole hash again together with the displacement, so keys of one group land in unrelated slots, and
+// trying the next displacement moves all of them.
+constexpr size_t group_of(size_t hash, size_t group_mask) {
+    return (hash >> (sizeof(size_t) * 4)) & group_mask;
+}
+
+constexpr size_t slot_of(size_t hash, uint32_t displacement, size_t slot_mask) {
+    return static_cast<size_t>(mix_hash(hash + displacement * 0x9E3779B97F4A7C15ull)) & slot_mask;
+}
+
+// Fills 'displacements' and 'slots' for the keys with the given mixed hashes. 'slots' gets the index of the key in
+// every used slot and kEmpty in the others. 'start' needs num_groups + 1 elements, 'members' and 'candidates' one
+// per key. Works on plain pointers, so that the same code fills std::arrays in a constant expression and vectors.
+constexpr void build(const size_t* hashes, size_t size, uint32_t* displacements, size_t num_groups, uint32_t* slots,
+                     size_t num_slots, uint32_t* start, uint32_t* members, size_t* candidates) {
+    for (size_t i = 0; i < num_slots; ++i)
+        slots[i] = kEmpty;
+    for (size_t i = 0; i <= num_groups; ++i)
+        start[i] = 0;
+    for (size_t i = 0; i < size; ++i)
+        ++start[group_of(hashes[i], num_groups - 1) + 1];
+    size_t largest = 0;
+    for (size_t group = 0; group < num_groups; ++group) {
+        if (start[group + 1] > largest)
+            largest = start[group + 1];
+        start[group + 1] += start[group];
+    }
+    // The displacements serve as the fill cursors of the groups until they are searched for.
+    for (size_t group = 0; group < num_groups; ++group)
+        displacements[group] = start[group];
+    for (size_t i = 0; i < size; ++i)
+        members[displacements[group_of(hashes[i], num_groups - 1)]++] = static_cast<uint32_t>(i);
+
+    for (size_t group_size = largest; group_size > 0; --group_size) {
+        for (size_t group = 0; group < num_groups; ++group) {
+            const uint32_t* first = members + start[group];
+            if (start[group + 1] - start[group] != group_size)
+                continue;
+            for (size_t i = 0; i < group_size; ++i) {
+                for (size_t j = 0; j < i; ++j) {
+                    if (hashes[first[i]] == hashes[first[j]])
+                        throw std::invalid_argument("keys must be distinct and have distinct hashes");
+                }
+            }
+
+            uint32_t displacement = 0;
+            for (;; ++displacement) {
+                if (displacement == kMaxDisplacement)
+                    throw std::runtime_error("cannot place the keys");
+                size_t placed = 0;
+                for (; placed < group_size; ++placed) {
+                    size_t slot = slot_of(hashes[first[placed]], displacement, num_slots - 1);
+                    if (slots[slot] != kEmpty)
+                        break;
+                    size_t other = 0;
+                    while (other < placed && candidates[other] != slot)
+                        ++other;
+                    if (other != placed)
+                        break;
+                    candidates[placed] = slot;
+                }
+                if (placed == group_size)
+                    break;
+            }
+            displacements[group] = displacement;
+            for (size_t i = 0; i < group_size; ++i)
+                slots[candidates[i]] = first[i];
+        }
+    }
+    // Empty groups are never searched; any displacement leads to a slot whose key does not match.
+    for (size_t group = 0; group < num_groups; ++group) {
+        if (start[group] == start[group + 1])
+            displacements[group] = 0;
+    }
+}
+
+// Lookups by another key type K are allowed if both Hash and KeyEqual are transparent.
+template<class Hash, class KeyEqual, class = void>
+struct is_transparent : std::false_type {};
+
+template<class Hash, class KeyEqual>
+struct is_transparent<Hash, KeyEqual, std::void_t<typename Hash::is_transparent, typename KeyEqual::is_transparent>>
+    : std::true_type {};
+
+}  // namespace perfect_hash_detail
+
+template<class KeyType, class ValueType, size_t Size, class Hash = FixedHash,
+         class KeyEqual = std::equal_to<KeyType> >
+class FixedHashMap {
+public:
+    using value_type = std::pair<const KeyType, ValueType>;
+    using const_iterator = const value_type*;
+    using iterator = const_iterator;
+
+private:
+    static constexpr size_t kGroups = perfect_hash_detail::group_count(Size);
+    static constexpr size_t kSlots = perfect_hash_detail::slot_count(Size);
+
+    Hash hasher_;
+    KeyEqual key_equal_;
+    std::array<value_type, Size> entries_;
+    std::array<uint32_t, kGroups> displacements_{};
+    std::array<uint32_t, kSlots> slots_{};
+
+    template<class K>
+    using if_transparent = typename std::enable_if<perfect_hash_detail::is_transparent<Hash, KeyEqual>::value &&
+                                                   !std::is_same<K, KeyType>::value, int>::type;
+
+    template<size_t... I>
+    constexpr FixedHashMap(const value_type* elements, std::index_sequence<I...>, Hash hasher_obj,
+                           const KeyEqual& equal)
+        : hasher_(hasher_obj), key_equal_(equal), entries_{{elements[I]...}} {
+        std::array<size_t, Size> hashes{};
+        for (size_t i = 0; i < Size; ++i)
+            hashes[i] = perfect_hash_detail::key_hash(hasher_, entries_[i].first);
+        std::array<uint32_t, kGroups + 1> start{};
+        std::array<uint32_t, Size> members{};
+        std::array<size_t, Size> candidates{};
+        perfect_hash_detail::build(hashes.data(), Size, displacements_.data(), kGroups, slots_.data(), kSlots,
+                                   start.data(), members.data(), candidates.data());
+    }
+
+    template<class K>
+    constexpr const_iterator find_key(const K& key) const {
+        size_t hash = perfect_hash_detail::key_hash(hasher_, key);
+        uint32_t displacement = displacements_[perfect_hash_detail::group_of(hash, kGroups - 1)];
+        uint32_t index = slots_[perfect_hash_detail::slot_of(hash, displacement, kSlots - 1)];
+        if (index != perfect_hash_detail::kEmpty && key_equal_(entries_[index].first, key))
+            return entries_.data() + index;
+        return end();
+    }
+
+    template<class K>
+    constexpr const ValueType& checked_at(const K& key) const {
+        const_iterator iter = find_key(key);
+        if (iter == end())
+            throw std::out_of_range("no such element");
+        return iter->second;
+    }
+
+public:
+    constexpr explicit FixedHashMap(const value_type (&elements)[Size], Hash hasher_obj = Hash(),
+                                    const KeyEqual& equal = KeyEqual())
+        : FixedHashMap(elements, std::make_index_sequence<Size>(), hasher_obj, equal) {}
+
+    constexpr explicit FixedHashMap(const std::array<value_type, Size>& elements, Hash hasher_obj = Hash(),
+                                    const KeyEqual& equal = KeyEqual())
+        : FixedHashMap(elements.data(), std::make_index_sequence<Size>(), hasher_obj, equal) {}
+
+    constexpr const_iterator find(const KeyType& key) const {
+        return find_key(key);
+    }
+
+    template<class K, if_transparent<K> = 0>
+    constexpr const_iterator find(const K& key) const {
+        return find_key(key);
+    }
+
+    constexpr bool contains(const KeyType& key) const {
+        return find_key(key) != end();
+    }
+
+    template<class K, if_transparent<K> = 0>
+    constexpr bool contains(const K& key) const {
+        return find_key(key) != end();
+    }
+
+    constexpr const ValueType& at(const KeyType& key) const {
+        return checked_at(key);
+    }
+
+    template<class K, if_transparent<K> = 0>
+    constexpr const ValueType& at(const K& key) const {
+        return checked_at(key);
+    }
+
+    constexpr size_t size() const {
+        return Size;
+    }
+
+    constexpr bool empty() const {
+        return Size == 0;
+    }
+
+    constexpr Hash hash_function() const {
+        return hasher_;
+    }
+
+    constexpr KeyEqual key_eq() const {
+        return key_equal_;
+    }
+
+    constexpr const_iterator begin() const {
+        return entries_.data();
+    }
+    constexpr const_iterator end() const {
+        return entries_.data() + Size;
+    }
+};
+
+// Builds a FixedHashMap from a braced list, which fixes the size:
+// constexpr auto map = make_fixed_hash_map<std::string_view, int>({{"one", 1}, {"two", 2}});
+template<class KeyType, class ValueType, class Hash = FixedHash, class KeyEqual = std::equal_to<KeyType>, size_t Size>
+constexpr FixedHashMap<KeyType, ValueType, Size, Hash, KeyEqual> make_fixed_hash_map(
+        const std::pair<const KeyType, ValueType> (&elements)[Size], Hash hasher_obj = Hash(),
+        const KeyEqual& equal = KeyEqual()) {
+    return FixedHashMap<KeyType, ValueType, Size, Hash, KeyEqual>(elements, hasher_obj, equal);
+}
+
+template<class KeyType, class ValueType, class Hash = FixedHash, class KeyEqual = std::equal_to<KeyType> >
+class PerfectHashMap {
+public:
+    using value_type = std::pair<const KeyType, ValueType>;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+    using iterator = const_iterator;
+
+private:
+    Hash hasher_;
+    KeyEqual key_equal_;
+    std::vector<value_type> entries_;
+    std::vector<uint32_t> displacements_;
+    std::vector<uint32_t> slots_;
+
+    template<class K>
+    using if_transparent = typename std::enable_if<perfect_hash_detail::is_transparent<Hash, KeyEqual>::value &&
+                                                   !std::is_same<K, KeyType>::value, int>::type;
+
+    void InitializeTable() {
+        if (entries_.size() >= perfect_hash_detail::kEmpty)
+            throw std::length_error("too many keys for a perfect hash map");
+        size_t size = entries_.size();
+        std::vector<size_t> hashes(size);
+        for (size_t i = 0; i < size; ++i)
+            hashes[i] = perfect_hash_detail::key_hash(hasher_, entries_[i].first);
+        displacements_.assign(perfect_hash_detail::group_count(size), 0);
+        slots_.assign(perfect_hash_detail::slot_count(size), perfect_hash_detail::kEmpty);
+        std::vector<uint32_t> start(displacements_.size() + 1);
+        std::vector<uint32_t> members(size);
+        std::vector<size_t> candidates(size);
+        perfect_hash_detail::build(hashes.data(), size, displacements_.data(), displacements_.size(), slots_.data(),
+                                   slots_.size(), start.data(), members.data(), candidates.data());
+    }
+
+    template<class K>
+    const_iterator find_key(const K& key) const {
+        size_t hash = perfect_hash_detail::key_hash(hasher_, key);
+        uint32_t displacement = displacements_[perfect_hash_detail::group_of(hash, displacements_.size() - 1)];
+        uint32_t index = slots_[perfect_hash_detail::slot_of(hash, displacement, slots_.size() - 1)];
+        if (index != perfect_hash_detail::kEmpty && key_equal_(entries_[index].first, key))
+            return entries_.begin() + index;
+        return end();
+    }
+
+    template<class K>
+    const ValueType& checked_at(const K& key) const {
+        const_iterator iter = find_key(key);
+        if (iter == end())
+            throw std::out_of_range("no such element");
+        return iter->second;
+    }
+
+public:
+    template<typename _ForwardIterator>
+    PerfectHashMap(_ForwardIterator begin, _ForwardIterator end, Hash hasher_obj = Hash(),
+                   const KeyEqual& equal = KeyEqual()) : hasher_(hasher_obj), key_equal_(equal), entries_(begin, end) {
+        InitializeTable();
+    }
+
+    PerfectHashMap(std::initializer_list<value_type> list, Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual())
+        : PerfectHashMap(list.begin(), list.end(), hasher_obj, equal) {}
+
+    const_iterator find(const KeyType& key) const {
+        return find_key(key);
+    }
+
+    template<class K, if_transparent<K> = 0>
+    const_iterator find(const K& key) const {
+        return find_key(key);
+    }
+
+    bool contains(const KeyType& key) const {
+        return find_key(key) != end();
+    }
+
+    template<class K, if_transparent<K> = 0>
+    bool contains(const K& key) const {
+        return find_key(key) != end();
+    }
+
+    const ValueType& at(const KeyType& key) const {
+        return checked_at(key);
+    }
+
+    template<class K, if_transparent<K> = 0>
+    const ValueType& at(const K& key) const {
+        return checked_at(key);
+    }
+
+    size_t size() const {
+        return entries_.size();
+    }
+
+    bool empty() const {
+        return entries_.empty();
+    }
+
+    Hash hash_function() const {
+        return hasher_;
+    }
+
+    KeyEqual key_eq() const {
+        return key_equal_;
+    }
+
+    const_iterator begin() const {
+        return entries_.begin();
+    }
+    const_iterator end() const {
+        return entries_.end();
+    }
+};
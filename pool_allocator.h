@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "page_memory.h"
+
+/**
+ * Slab allocator for list nodes, meant to be used as the Allocator of HashMap.
+ * Memory is taken from the heap in slabs, which double in size from 4 KiB up to 1 MiB, and nodes are cut
+ * from the current slab one after another, so consecutively inserted elements lie next to each other.
+ * Freed nodes are put on a free list of their size class and reused by the next allocation of that size,
+ * so both allocation and deallocation are a couple of pointer operations. The slabs themselves are returned
+ * to the heap all at once when the last allocator sharing the arena is destroyed, or by release(). The arena counts
+ * the nodes it has handed out, so a HashMap that holds all of them and whose elements need no destructor drops them
+ * with release() in clear() and in its destructor instead of freeing them one by one.
+ * Only single nodes of at most kMaxPooledSize bytes are pooled; arrays (the bucket vector of HashMap) and
+ * bigger or over-aligned objects go straight to operator new.
+ * An arena built with PageOptions (see page_memory.h) maps its slabs instead, at least one page each, so the nodes
+ * get huge pages or a NUMA placement; arrays of at least kMinMappedSize bytes are then mapped with the same options,
+ * which puts the bucket vector of a large HashMap there too. With huge pages every slab takes at least 2 MiB, also
+ * with kHuge1G, which uses 1 GiB pages only for arrays of a gigabyte or more, so a small map on such an arena
+ * reserves a few megabytes rather than gigabytes.
+ * All the copies and rebinds of a PoolAllocator share one NodeArena, which is not thread-safe.
+ */
+
+class NodeArena {
+public:
+    static constexpr size_t kGranularity = alignof(std::max_align_t);
+    static constexpr size_t kMaxPooledSize = 256;
+    static constexpr size_t kMinMappedSize = 64 << 10;
+
+    NodeArena() = default;
+
+    explicit NodeArena(const PageOptions& options) : options_(options) {}
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator= (const NodeArena&) = delete;
+
+    void* allocate(size_t bytes) {
+        size_t size_class = (bytes + kGranularity - 1) / kGranularity;
+        FreeNode*& head = free_lists_[size_class];
+        if (head != nullptr) {
+            FreeNode* node = head;
+            head = node->next;
+            ++live_nodes_;
+            return node;
+        }
+
+        size_t rounded = size_class * kGranularity;
+        if (slab_left_ < rounded)
+            add_slab(rounded);
+        void* result = slab_cursor_;
+        slab_cursor_ += rounded;
+        slab_left_ -= rounded;
+        ++live_nodes_;
+        return result;
+    }
+
+    void deallocate(void* p, size_t bytes) {
+        size_t size_class = (bytes + kGranularity - 1) / kGranularity;
+        FreeNode* node = static_cast<FreeNode*>(p);
+        node->next = free_lists_[size_class];
+        free_lists_[size_class] = node;
+        --live_nodes_;
+    }
+
+    // Gives all the slabs back at once, together with every node cut from them, and starts over empty. Whoever still
+    // holds one of those nodes must not touch it again; arrays are not affected.
+    void release() noexcept {
+        free_slabs();
+        slabs_.clear();
+        for (auto &head : free_lists_)
+            head = nullptr;
+        slab_cursor_ = nullptr;
+        slab_left_ = 0;
+        next_slab_size_ = kMinSlabSize;
+        reserved_bytes_ = 0;
+        live_nodes_ = 0;
+    }
+
+    static bool is_pooled(size_t bytes, size_t alignment) {
+        return bytes <= kMaxPooledSize && alignment <= kGranularity;
+    }
+
+    // Whether an array of this size is mapped with the page options rather than taken from operator new.
+    bool is_mapped(size_t bytes, size_t alignment) const {
+        return !options_.is_default() && bytes >= kMinMappedSize && alignment <= page_bytes(options_);
+    }
+
+    void* allocate_mapped(size_t bytes) const {
+        return map_pages(bytes, options_);
+    }
+
+    void deallocate_mapped(void* p, size_t bytes) const {
+        unmap_pages(p, bytes, options_);
+    }
+
+    const PageOptions& options() const {
+        return options_;
+    }
+
+    // Number of bytes taken from the heap in slabs.
+    size_t reserved_bytes() const {
+        return reserved_bytes_;
+    }
+
+    // Number of nodes allocated and not deallocated yet.
+    size_t live_nodes() const {
+        return live_nodes_;
+    }
+
+    ~NodeArena() {
+        free_slabs();
+    }
+
+private:
+    static constexpr size_t kMinSlabSize = 4 << 10;
+    static constexpr size_t kMaxSlabSize = 1 << 20;
+
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    struct Slab {
+        void* memory;
+        size_t size;
+    };
+
+    void free_slabs() noexcept {
+        for (auto &slab : slabs_) {
+            if (options_.is_default())
+                ::operator delete(slab.memory);
+            else
+                unmap_pages(slab.memory, slab.size, options_);
+        }
+    }
+
+    void add_slab(size_t at_least) {
+        size_t size = slabs_.empty() ? kMinSlabSize : next_slab_size_;
+        if (size < at_least)
+            size = at_least;
+        slabs_.reserve(slabs_.size() + 1);
+        if (options_.is_default()) {
+            slab_cursor_ = static_cast<unsigned char*>(::operator new(size));
+        } else {
+            // A mapped slab takes whole pages, so it might as well use all of them.
+            size = mapped_bytes(size, options_);
+            slab_cursor_ = static_cast<unsigned char*>(map_pages(size, options_));
+        }
+        slabs_.push_back({slab_cursor_, size});
+        slab_left_ = size;
+        reserved_bytes_ += size;
+        next_slab_size_ = size * 2 < kMaxSlabSize ? size * 2 : kMaxSlabSize;
+    }
+
+    FreeNode* free_lists_[kMaxPooledSize / kGranularity + 1] = {};
+    std::vector<Slab> slabs_;
+    PageOptions options_;
+    unsigned char* slab_cursor_ = nullptr;
+    size_t slab_left_ = 0;
+    size_t next_slab_size_ = kMinSlabSize;
+    size_t reserved_bytes_ = 0;
+    size_t live_nodes_ = 0;
+};
+
+template<class T>
+class PoolAllocator {
+public:
+    using value_type = T;
+    // A container that is copied gets an arena of its own, while moving and swapping hand the arena over.
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    PoolAllocator() : arena_(std::make_shared<NodeArena>()) {}
+
+    explicit PoolAllocator(std::shared_ptr<NodeArena> arena) : arena_(std::move(arena)) {}
+
+    // An allocator with an arena of its own that maps its memory with the given options.
+    explicit PoolAllocator(const PageOptions& options) : arena_(std::make_shared<NodeArena>(options)) {}
+
+    // Allocators have to stay usable after being moved from, so moving one copies the arena pointer.
+    PoolAllocator(const PoolAllocator& other) noexcept = default;
+    PoolAllocator& operator= (const PoolAllocator& other) noexcept = default;
+
+    template<class U>
+    PoolAllocator(const PoolAllocator<U>& other) noexcept : arena_(other.arena()) {}
+
+    T* allocate(size_t n) {
+        if (n == 1 && NodeArena::is_pooled(sizeof(T), alignof(T)))
+            return static_cast<T*>(arena_->allocate(sizeof(T)));
+        if (n <= SIZE_MAX / sizeof(T) && arena_->is_mapped(n * sizeof(T), alignof(T)))
+            return static_cast<T*>(arena_->allocate_mapped(n * sizeof(T)));
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) {
+        if (n == 1 && NodeArena::is_pooled(sizeof(T), alignof(T)))
+            arena_->deallocate(p, sizeof(T));
+        else if (n <= SIZE_MAX / sizeof(T) && arena_->is_mapped(n * sizeof(T), alignof(T)))
+            arena_->deallocate_mapped(p, n * sizeof(T));
+        else
+            std::allocator<T>().deallocate(p, n);
+    }
+
+    // The copy gets a fresh arena with the same page options.
+    PoolAllocator select_on_container_copy_construction() const {
+        return PoolAllocator(std::make_shared<NodeArena>(arena_->options()));
+    }
+
+    const std::shared_ptr<NodeArena>& arena() const {
+        return arena_;
+    }
+
+    // A copy that uses the same arena without keeping it alive, for objects that never outlive an owning copy and
+    // that may be abandoned without their destructor when the arena is released. It compares equal to this one.
+    PoolAllocator unowned() const {
+        return PoolAllocator(std::shared_ptr<NodeArena>(std::shared_ptr<NodeArena>(), arena_.get()));
+    }
+
+    size_t live_nodes() const {
+        return arena_->live_nodes();
+    }
+
+    void release() const {
+        arena_->release();
+    }
+
+    template<class U>
+    bool operator==(const PoolAllocator<U>& other) const {
+        return arena_ == other.arena();
+    }
+    template<class U>
+    bool operator!=(const PoolAllocator<U>& other) const {
+        return arena_ != other.arena();
+    }
+
+private:
+    std::shared_ptr<NodeArena> arena_;
+};
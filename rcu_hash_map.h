@@ -0,0 +1,243 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include "bucket_policy.h"
+#include "epoch.h"
+
+/**
+ * Concurrent map for read-mostly workloads, where lookups take no locks at all.
+ * The table is an array of atomic chain heads, published through an atomic pointer. Chain nodes never change after
+ * they are published, except for their next pointers: insert links a fully built node at the head of its chain,
+ * insert_or_assign links a new node in place of the old one, and erase unlinks the node. Rehashing builds a complete
+ * new table, with copies of all the nodes, and swaps the table pointer. So a reader always sees a consistent chain,
+ * and it never waits for a writer, whatever the writer is doing.
+ * Unlinked nodes and replaced tables are freed through the EpochDomain only after every reader that could have reached
+ * them has finished. Writers are serialized by a mutex; that is the only lock, and readers never touch it.
+ * Since nothing is locked during a lookup, find returns a copy of the value and visit calls a function on it, instead
+ * of returning an iterator.
+ */
+
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class KeyEqual = std::equal_to<KeyType> >
+class RcuHashMap {
+    struct Node {
+        template<class K, class... Args>
+        Node(size_t key_hash, K&& key_obj, Args&&... args)
+            : key(std::forward<K>(key_obj)), value(std::forward<Args>(args)...), hash(key_hash) {}
+
+        const KeyType key;
+        const ValueType value;
+        const size_t hash;
+        std::atomic<Node*> next{nullptr};
+    };
+
+    struct Table {
+        explicit Table(size_t bucket_count) : capacity(PowerOfTwoBucketPolicy::round_capacity(bucket_count)),
+                                              buckets(new std::atomic<Node*>[capacity]) {
+            policy.reset(capacity);
+            for (size_t i = 0; i < capacity; ++i)
+                buckets[i].store(nullptr, std::memory_order_relaxed);
+        }
+
+        Table(const Table&) = delete;
+        Table& operator= (const Table&) = delete;
+
+        std::atomic<Node*>& bucket(size_t hash) {
+            return buckets[policy.index(hash)];
+        }
+
+        ~Table() {
+            for (size_t i = 0; i < capacity; ++i) {
+                Node* node = buckets[i].load(std::memory_order_relaxed);
+                while (node != nullptr) {
+                    Node* next = node->next.load(std::memory_order_relaxed);
+                    delete node;
+                    node = next;
+                }
+            }
+            delete[] buckets;
+        }
+
+        size_t capacity;
+        PowerOfTwoBucketPolicy policy;
+        std::atomic<Node*>* buckets;
+    };
+
+    static constexpr size_t kInitialCapacity = 16;
+    static constexpr size_t kGrowthFactor = 2;
+
+    Hash hasher_;
+    KeyEqual key_equal_;
+    std::atomic<Table*> table_;
+    std::atomic<size_t> num_elements_{0};
+    std::mutex write_mutex_;
+
+    // Returns the link pointing at the node with the key, or the null link ending the chain. Needs write_mutex_.
+    template<class K>
+    std::atomic<Node*>* find_link(Table* table, const K& key, size_t hash) {
+        std::atomic<Node*>* link = &table->bucket(hash);
+        for (Node* node = link->load(std::memory_order_relaxed); node != nullptr;
+             node = link->load(std::memory_order_relaxed)) {
+            if (node->hash == hash && key_equal_(node->key, key))
+                return link;
+            link = &node->next;
+        }
+        return link;
+    }
+
+    template<class K>
+    const Node* find_node(const K& key) const {
+        size_t hash = hasher_(key);
+        Table* table = table_.load(std::memory_order_acquire);
+        for (const Node* node = table->bucket(hash).load(std::memory_order_acquire); node != nullptr;
+             node = node->next.load(std::memory_order_acquire)) {
+            if (node->hash == hash && key_equal_(node->key, key))
+                return node;
+        }
+        return nullptr;
+    }
+
+    // Readers keep using the old table until they are done with it, so the new one gets copies of all the nodes.
+    // Until it is published, the new table is owned here, so if a copy throws, it is freed together with the nodes
+    // copied so far.
+    // Needs write_mutex_.
+    void try_to_rehash(Table* table) {
+        if (num_elements_.load(std::memory_order_relaxed) <= table->capacity)
+            return;
+
+        std::unique_ptr<Table> new_table(new Table(table->capacity * kGrowthFactor));
+        for (size_t i = 0; i < table->capacity; ++i) {
+            for (Node* node = table->buckets[i].load(std::memory_order_relaxed); node != nullptr;
+                 node = node->next.load(std::memory_order_relaxed)) {
+                Node* copy = new Node(node->hash, node->key, node->value);
+                std::atomic<Node*>& head = new_table->bucket(copy->hash);
+                copy->next.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                head.store(copy, std::memory_order_relaxed);
+            }
+        }
+        table_.store(new_table.release(), std::memory_order_release);
+        EpochDomain::instance().retire(table);
+    }
+
+    template<class K, class... Args>
+    bool insert_node(bool assign, K&& key, Args&&... args) {
+        size_t hash = hasher_(key);
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        Table* table = table_.load(std::memory_order_relaxed);
+        std::atomic<Node*>* link = find_link(table, key, hash);
+        Node* old = link->load(std::memory_order_relaxed);
+        if (old != nullptr && !assign)
+            return false;
+
+        Node* node = new Node(hash, std::forward<K>(key), std::forward<Args>(args)...);
+        if (old != nullptr) {
+            node->next.store(old->next.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            link->store(node, std::memory_order_release);
+            EpochDomain::instance().retire(old);
+            return false;
+        }
+
+        std::atomic<Node*>& head = table->bucket(hash);
+        node->next.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        head.store(node, std::memory_order_release);
+        num_elements_.fetch_add(1, std::memory_order_relaxed);
+        try_to_rehash(table);
+        return true;
+    }
+
+public:
+    explicit RcuHashMap(Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual())
+        : hasher_(hasher_obj), key_equal_(equal), table_(new Table(kInitialCapacity)) {}
+
+    RcuHashMap(const RcuHashMap&) = delete;
+    RcuHashMap& operator= (const RcuHashMap&) = delete;
+
+    // Returns true if the element was inserted, false if the key was already there.
+    bool insert(const std::pair<const KeyType, ValueType>& obj) {
+        return insert_node(false, obj.first, obj.second);
+    }
+
+    template<class K, class... Args>
+    bool try_emplace(K&& key, Args&&... args) {
+        return insert_node(false, std::forward<K>(key), std::forward<Args>(args)...);
+    }
+
+    // Readers see either the old value or the new one, never a partly written value.
+    template<class K, class M>
+    bool insert_or_assign(K&& key, M&& obj) {
+        return insert_node(true, std::forward<K>(key), std::forward<M>(obj));
+    }
+
+    // Returns true if the key was erased.
+    template<class K>
+    bool erase(const K& key) {
+        size_t hash = hasher_(key);
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        std::atomic<Node*>* link = find_link(table_.load(std::memory_order_relaxed), key, hash);
+        Node* node = link->load(std::memory_order_relaxed);
+        if (node == nullptr)
+            return false;
+
+        link->store(node->next.load(std::memory_order_relaxed), std::memory_order_release);
+        num_elements_.fetch_sub(1, std::memory_order_relaxed);
+        EpochDomain::instance().retire(node);
+        return true;
+    }
+
+    template<class K>
+    std::optional<ValueType> find(const K& key) const {
+        EpochGuard guard;
+        const Node* node = find_node(key);
+        if (node == nullptr)
+            return std::nullopt;
+        return node->value;
+    }
+
+    // Calls fn(const ValueType&) if the key is present; the value stays alive until fn returns.
+    template<class K, class F>
+    bool visit(const K& key, F&& fn) const {
+        EpochGuard guard;
+        const Node* node = find_node(key);
+        if (node == nullptr)
+            return false;
+        std::forward<F>(fn)(node->value);
+        return true;
+    }
+
+    template<class K>
+    bool contains(const K& key) const {
+        EpochGuard guard;
+        return find_node(key) != nullptr;
+    }
+
+    size_t size() const {
+        return num_elements_.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        Table* old = table_.load(std::memory_order_relaxed);
+        table_.store(new Table(kInitialCapacity), std::memory_order_release);
+        num_elements_.store(0, std::memory_order_relaxed);
+        EpochDomain::instance().retire(old);
+    }
+
+    Hash hash_function() const {
+        return hasher_;
+    }
+
+    // Expects that no other thread uses the map anymore.
+    ~RcuHashMap() {
+        delete table_.load(std::memory_order_relaxed);
+    }
+};
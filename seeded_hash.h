@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string_view>
+#include <type_traits>
+
+#include "bucket_policy.h"
+
+/**
+ * Keyed hashing for maps whose keys come from untrusted input.
+ * SeededHash is SipHash-1-3 under a 128-bit key, the seed. Without the seed an attacker cannot tell which keys collide,
+ * so it cannot pick keys that all land in one bucket. Every SeededHash gets a fresh random seed unless one is given.
+ * HashMap knows how to reseed it, which it does when it sees a suspiciously long chain.
+ * The hasher is transparent and hashes strings by their characters, so std::string, std::string_view and const char*
+ * keys agree. Integral and enum keys are hashed by their value widened to 64 bits, so that a transparent lookup by
+ * an int finds a uint64_t key with the same value.
+ */
+
+struct HashSeed {
+    uint64_t k0;
+    uint64_t k1;
+};
+
+namespace seeded_hash_detail {
+
+inline uint64_t rotl(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+struct SipState {
+    uint64_t v0, v1, v2, v3;
+
+    SipState(HashSeed seed) : v0(seed.k0 ^ 0x736F6D6570736575ull), v1(seed.k1 ^ 0x646F72616E646F6Dull),
+                              v2(seed.k0 ^ 0x6C7967656E657261ull), v3(seed.k1 ^ 0x7465646279746573ull) {}
+
+    void round() {
+        v0 += v1;
+        v1 = rotl(v1, 13);
+        v1 ^= v0;
+        v0 = rotl(v0, 32);
+        v2 += v3;
+        v3 = rotl(v3, 16);
+        v3 ^= v2;
+        v0 += v3;
+        v3 = rotl(v3, 21);
+        v3 ^= v0;
+        v2 += v1;
+        v1 = rotl(v1, 17);
+        v1 ^= v2;
+        v2 = rotl(v2, 32);
+    }
+
+    void absorb(uint64_t word) {
+        v3 ^= word;
+        round();
+        v0 ^= word;
+    }
+
+    uint64_t finish() {
+        v2 ^= 0xFF;
+        round();
+        round();
+        round();
+        return v0 ^ v1 ^ v2 ^ v3;
+    }
+};
+
+// SipHash-1-3: one compression round per word and three finalization rounds.
+inline uint64_t siphash13(HashSeed seed, const void* data, size_t size) {
+    SipState state(seed);
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    size_t tail = size & 7;
+    for (const unsigned char* end = bytes + size - tail; bytes != end; bytes += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes, 8);
+        state.absorb(word);
+    }
+    uint64_t last = static_cast<uint64_t>(size) << 56;
+    for (size_t i = 0; i < tail; ++i)
+        last |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+    state.absorb(last);
+    return state.finish();
+}
+
+}  // namespace seeded_hash_detail
+
+// A fresh random value for every call. The random device is read once; later values are derived from it by a counter,
+// since maps may be created far more often than a random device can be read.
+inline uint64_t random_seed() {
+    static const uint64_t base = (static_cast<uint64_t>(std::random_device()()) << 32) ^ std::random_device()();
+    static std::atomic<uint64_t> counter{0};
+    return mix_hash(base + counter.fetch_add(0x9E3779B97F4A7C15ull, std::memory_order_relaxed));
+}
+
+class SeededHash {
+public:
+    using is_transparent = void;
+
+    SeededHash() {
+        reseed();
+    }
+
+    explicit SeededHash(HashSeed seed) : seed_(seed) {}
+
+    size_t operator()(std::string_view str) const {
+        return static_cast<size_t>(seeded_hash_detail::siphash13(seed_, str.data(), str.size()));
+    }
+
+    template<class T, class = typename std::enable_if<std::is_integral<T>::value>::type>
+    size_t operator()(T value) const {
+        uint64_t wide = static_cast<uint64_t>(value);
+        return static_cast<size_t>(seeded_hash_detail::siphash13(seed_, &wide, sizeof(wide)));
+    }
+
+    template<class T, class = typename std::enable_if<std::is_enum<T>::value>::type, class = void>
+    size_t operator()(T value) const {
+        return (*this)(static_cast<typename std::underlying_type<T>::type>(value));
+    }
+
+    HashSeed seed() const {
+        return seed_;
+    }
+
+    void reseed(HashSeed seed) {
+        seed_ = seed;
+    }
+
+    void reseed() {
+        seed_ = {random_seed(), random_seed()};
+    }
+
+private:
+    HashSeed seed_;
+};
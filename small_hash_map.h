@@ -0,0 +1,356 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "hash_map.h"
+
+/**
+ * Map for the common case of very few elements. Up to InlineCapacity 'key, value' pairs are kept in an array
+ * inside the object itself and are found by a linear scan with KeyEqual, with no hashing and no heap allocation.
+ * Inserting one more element copies all of them into a HashMap, which the map keeps using from then on, until clear().
+ * Erasure from the inline array moves the last element into the hole, so in small mode erase invalidates iterators
+ * to the erased and to the last element, and the switch to the HashMap invalidates all of them. In large mode the
+ * rules of HashMap apply. If the move of the last element may throw, small-mode erase copies it first and leaves
+ * the map as it was when that copy throws; when putting the copy into the hole throws after all, the elements from
+ * the hole on are dropped.
+ */
+
+template<class KeyType, class ValueType, size_t InlineCapacity = 8, class Hash = std::hash<KeyType>,
+         class KeyEqual = std::equal_to<KeyType> >
+class SmallHashMap {
+public:
+    using value_type = std::pair<const KeyType, ValueType>;
+    using large_map_type = HashMap<KeyType, ValueType, Hash, KeyEqual>;
+
+private:
+    struct Slot {
+        alignas(value_type) unsigned char storage[sizeof(value_type)];
+
+        value_type* value() {
+            return std::launder(reinterpret_cast<value_type*>(storage));
+        }
+        const value_type* value() const {
+            return std::launder(reinterpret_cast<const value_type*>(storage));
+        }
+    };
+
+    template<bool IsConst>
+    class Iterator {
+        using SlotPointer = typename std::conditional<IsConst, const Slot*, Slot*>::type;
+        using LargeIterator = typename std::conditional<IsConst, typename large_map_type::const_iterator,
+                                                        typename large_map_type::iterator>::type;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename SmallHashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = typename std::conditional<IsConst, const value_type*, value_type*>::type;
+        using reference = typename std::conditional<IsConst, const value_type&, value_type&>::type;
+
+        Iterator() = default;
+
+        // Every iterator may be turned into a const_iterator.
+        template<bool OtherConst, class = typename std::enable_if<IsConst && !OtherConst>::type>
+        Iterator(const Iterator<OtherConst>& other) : slot_(other.slot_), large_(other.large_),
+                                                      is_large_(other.is_large_) {}
+
+        reference operator*() const {
+            return is_large_ ? *large_ : *slot_->value();
+        }
+        pointer operator->() const {
+            return &**this;
+        }
+
+        Iterator& operator++() {
+            if (is_large_)
+                ++large_;
+            else
+                ++slot_;
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return is_large_ ? large_ == other.large_ : slot_ == other.slot_;
+        }
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend class SmallHashMap;
+        template<bool> friend class Iterator;
+
+        explicit Iterator(SlotPointer slot) : slot_(slot) {}
+        explicit Iterator(LargeIterator large) : large_(large), is_large_(true) {}
+
+        SlotPointer slot_ = nullptr;
+        LargeIterator large_{};
+        bool is_large_ = false;
+    };
+
+public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+private:
+    Hash hasher_;
+    KeyEqual key_equal_;
+    Slot slots_[InlineCapacity];
+    size_t num_inline_ = 0;
+    std::unique_ptr<large_map_type> large_;
+
+    size_t find_index(const KeyType& key) const {
+        for (size_t i = 0; i < num_inline_; ++i) {
+            if (key_equal_(slots_[i].value()->first, key))
+                return i;
+        }
+        return num_inline_;
+    }
+
+    void destroy_inline() {
+        for (size_t i = 0; i < num_inline_; ++i)
+            slots_[i].value()->~value_type();
+        num_inline_ = 0;
+    }
+
+    // Moves the inline elements of 'other' into this map, which holds none yet. Elements whose move may throw are
+    // copied, so if that throws, the ones built so far are destroyed and 'other' still has all of its elements.
+    void take_inline(SmallHashMap& other) {
+        try {
+            for (; num_inline_ < other.num_inline_; ++num_inline_) {
+                new (slots_[num_inline_].storage)
+                    value_type(std::move_if_noexcept(*other.slots_[num_inline_].value()));
+            }
+        } catch (...) {
+            destroy_inline();
+            throw;
+        }
+        other.destroy_inline();
+    }
+
+    // Copies the inline elements into a new HashMap, which takes over from now on. They are destroyed only once the
+    // HashMap holds all of them, so an exception leaves the map in small mode as it was. Elements that cannot be
+    // copied are moved, and then a failure loses the ones moved so far.
+    // The HashMap starts with the buckets for the inline elements and the one being inserted, so the switch
+    // allocates a single bucket array.
+    void switch_to_large() {
+        const auto buckets = static_cast<size_t>(std::ceil((InlineCapacity + 1) /
+                                                           large_map_type::kDefaultMaxLoadFactor));
+        auto large = std::make_unique<large_map_type>(buckets, hasher_, key_equal_);
+        for (size_t i = 0; i < num_inline_; ++i) {
+            if constexpr (std::is_copy_constructible<value_type>::value)
+                large->insert(std::as_const(*slots_[i].value()));
+            else
+                large->insert(std::move(*slots_[i].value()));
+        }
+        destroy_inline();
+        large_ = std::move(large);
+    }
+
+    template<class K, class... Args>
+    std::pair<iterator, bool> try_emplace_key(K&& key, Args&&... args) {
+        if (!large_) {
+            size_t index = find_index(key);
+            if (index != num_inline_)
+                return {iterator(slots_ + index), false};
+            if (num_inline_ < InlineCapacity) {
+                new (slots_[num_inline_].storage) value_type(std::piecewise_construct,
+                                                             std::forward_as_tuple(std::forward<K>(key)),
+                                                             std::forward_as_tuple(std::forward<Args>(args)...));
+                return {iterator(slots_ + num_inline_++), true};
+            }
+            switch_to_large();
+        }
+        auto result = large_->try_emplace(std::forward<K>(key), std::forward<Args>(args)...);
+        return {iterator(result.first), result.second};
+    }
+
+public:
+    explicit SmallHashMap(Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual())
+        : hasher_(hasher_obj), key_equal_(equal) {}
+
+    // Constructors are implemented as a bunch of insertions.
+    template<typename _ForwardIterator>
+    SmallHashMap(_ForwardIterator begin, _ForwardIterator end, Hash hasher_obj = Hash(),
+                 const KeyEqual& equal = KeyEqual()) : SmallHashMap(hasher_obj, equal) {
+        for (auto it = begin; it != end; ++it) {
+            insert(*it);
+        }
+    }
+
+    SmallHashMap(std::initializer_list<value_type> list, Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual())
+        : SmallHashMap(list.begin(), list.end(), hasher_obj, equal) {}
+
+    SmallHashMap(const SmallHashMap& other) : SmallHashMap(other.begin(), other.end(), other.hasher_,
+                                                           other.key_equal_) {}
+
+    // The source is left empty. If an inline element fails to be copied over, see take_inline(), the source is left
+    // as it was.
+    SmallHashMap(SmallHashMap&& other) : hasher_(other.hasher_), key_equal_(other.key_equal_) {
+        take_inline(other);
+        large_ = std::move(other.large_);
+    }
+
+    SmallHashMap& operator= (const SmallHashMap& other) {
+
+        //Anti-self-assignment.
+        if (this == &other)
+            return *this;
+
+        SmallHashMap copy(other);
+        *this = std::move(copy);
+        return *this;
+    }
+
+    // If an inline element fails to be copied over, this map is left empty and the source as it was.
+    SmallHashMap& operator= (SmallHashMap&& other) {
+        if (this == &other)
+            return *this;
+
+        clear();
+        hasher_ = other.hasher_;
+        key_equal_ = other.key_equal_;
+        take_inline(other);
+        large_ = std::move(other.large_);
+        return *this;
+    }
+
+    // Check if table contains the key and do nothing if it does, or add it.
+    iterator insert(const value_type& obj) {
+        return try_emplace_key(obj.first, obj.second).first;
+    }
+
+    iterator insert(value_type&& obj) {
+        return try_emplace_key(obj.first, std::move(obj.second)).first;
+    }
+
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(const KeyType& key, Args&&... args) {
+        return try_emplace_key(key, std::forward<Args>(args)...);
+    }
+
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(KeyType&& key, Args&&... args) {
+        return try_emplace_key(std::move(key), std::forward<Args>(args)...);
+    }
+
+    void erase(const KeyType& to_delete) {
+        if (large_) {
+            large_->erase(to_delete);
+            return;
+        }
+        size_t index = find_index(to_delete);
+        if (index == num_inline_)
+            return;
+
+        size_t last = num_inline_ - 1;
+        if (index == last || std::is_nothrow_move_constructible<value_type>::value) {
+            slots_[index].value()->~value_type();
+            if (index != last) {
+                new (slots_[index].storage) value_type(std::move(*slots_[last].value()));
+                slots_[last].value()->~value_type();
+            }
+            num_inline_ = last;
+            return;
+        }
+
+        // The last element is copied out before anything is destroyed, so a throwing copy leaves the map intact.
+        value_type moved(std::move_if_noexcept(*slots_[last].value()));
+        slots_[index].value()->~value_type();
+        try {
+            new (slots_[index].storage) value_type(std::move_if_noexcept(moved));
+        } catch (...) {
+            // The hole cannot be filled, so the array is cut short there to stay contiguous.
+            for (size_t i = index + 1; i < num_inline_; ++i)
+                slots_[i].value()->~value_type();
+            num_inline_ = index;
+            throw;
+        }
+        slots_[last].value()->~value_type();
+        num_inline_ = last;
+    }
+
+    iterator find(const KeyType& key) {
+        if (large_)
+            return iterator(large_->find(key));
+        return iterator(slots_ + find_index(key));
+    }
+
+    const_iterator find(const KeyType& key) const {
+        if (large_)
+            return const_iterator(static_cast<const large_map_type&>(*large_).find(key));
+        return const_iterator(slots_ + find_index(key));
+    }
+
+    ValueType& operator[](const KeyType& key) {
+        return try_emplace_key(key).first->second;
+    }
+
+    const ValueType& at(const KeyType& key) const {
+        const_iterator iter = find(key);
+        if (iter == end())
+            throw std::out_of_range("no such element");
+        return iter->second;
+    }
+
+    // Goes back to the inline array.
+    void clear() {
+        destroy_inline();
+        large_.reset();
+    }
+
+    // Whether the elements are still kept inline.
+    bool is_small() const {
+        return !large_;
+    }
+
+    Hash hash_function() const {
+        return hasher_;
+    }
+
+    KeyEqual key_eq() const {
+        return key_equal_;
+    }
+
+    size_t size() const {
+        return large_ ? large_->size() : num_inline_;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    iterator begin() {
+        return large_ ? iterator(large_->begin()) : iterator(slots_);
+    }
+    iterator end() {
+        return large_ ? iterator(large_->end()) : iterator(slots_ + num_inline_);
+    }
+    const_iterator begin() const {
+        const large_map_type* large = large_.get();
+        return large != nullptr ? const_iterator(large->begin()) : const_iterator(slots_);
+    }
+    const_iterator end() const {
+        const large_map_type* large = large_.get();
+        return large != nullptr ? const_iterator(large->end()) : const_iterator(slots_ + num_inline_);
+    }
+
+    ~SmallHashMap() {
+        destroy_inline();
+    }
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "bucket_policy.h"
+#include "seeded_hash.h"
+
+/**
+ * Binary snapshot format shared by HashMap::save, HashMap::load and MappedHashMap.
+ * A snapshot is a header, then bucket_count + 1 offsets into the record array (bucket i holds the records
+ * from offsets[i] to offsets[i + 1]), then the records themselves, each one a key and a value copied as raw bytes.
+ * Buckets are chosen by PowerOfTwoBucketPolicy from the full hash, whatever policy the saved map used, so a reader only
+ * needs the hasher, and the hasher has to give the same hashes in the process that reads the file. The seed of a
+ * seeded hasher such as SeededHash is stored in the header, so that MappedHashMap can hash with the same one.
+ * Sections start at multiples of 64 bytes, so a file mapped at a page boundary can be read in place. The layout is
+ * that of the host, so a snapshot is only meant to be read on the architecture that wrote it.
+ */
+
+namespace snapshot_detail {
+
+constexpr char kMagic[8] = {'H', 'M', 'S', 'N', 'A', 'P', '\0', '\0'};
+constexpr uint32_t kVersion = 2;
+constexpr size_t kAlignment = 64;
+
+template<class KeyType, class ValueType>
+struct Record {
+    KeyType first;
+    ValueType second;
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t record_size;
+    uint64_t size;
+    uint64_t bucket_count;
+    uint64_t offsets_offset;
+    uint64_t records_offset;
+    uint64_t file_size;
+    // Zero unless the hasher has a seed.
+    HashSeed hash_seed;
+};
+
+// Hashers that expose their seed, like SeededHash.
+template<class Hash, class = void>
+struct has_seed : std::false_type {};
+
+template<class Hash>
+struct has_seed<Hash, std::void_t<decltype(std::declval<const Hash&>().seed()),
+                                  decltype(std::declval<Hash&>().reseed(std::declval<HashSeed>()))>>
+    : std::true_type {};
+
+inline uint64_t align_up(uint64_t offset) {
+    return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+template<class KeyType, class ValueType>
+void check_types() {
+    static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value,
+                  "snapshots need trivially copyable keys and values");
+}
+
+template<class KeyType, class ValueType>
+Header make_header(uint64_t size, uint64_t bucket_count) {
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.key_size = sizeof(KeyType);
+    header.value_size = sizeof(ValueType);
+    header.record_size = sizeof(Record<KeyType, ValueType>);
+    header.size = size;
+    header.bucket_count = bucket_count;
+    header.offsets_offset = align_up(sizeof(Header));
+    header.records_offset = align_up(header.offsets_offset + (bucket_count + 1) * sizeof(uint64_t));
+    header.file_size = header.records_offset + size * header.record_size;
+    return header;
+}
+
+// Throws if the header does not describe a snapshot of these types that fits into 'file_size' bytes.
+template<class KeyType, class ValueType>
+void validate(const Header& header, uint64_t file_size) {
+    if (file_size < sizeof(Header))
+        throw std::runtime_error("not a hash map snapshot");
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0)
+        throw std::runtime_error("not a hash map snapshot");
+    if (header.version != kVersion)
+        throw std::runtime_error("unsupported hash map snapshot version");
+    if (header.key_size != sizeof(KeyType) || header.value_size != sizeof(ValueType) ||
+        header.record_size != sizeof(Record<KeyType, ValueType>))
+        throw std::runtime_error("hash map snapshot was written for other types");
+    if (header.bucket_count == 0 || (header.bucket_count & (header.bucket_count - 1)) != 0 ||
+        header.bucket_count > (file_size - sizeof(Header)) / sizeof(uint64_t) ||
+        header.size > file_size / header.record_size)
+        throw std::runtime_error("corrupted hash map snapshot");
+    Header expected = make_header<KeyType, ValueType>(header.size, header.bucket_count);
+    if (header.offsets_offset != expected.offsets_offset || header.records_offset != expected.records_offset ||
+        header.file_size != expected.file_size || header.file_size != file_size)
+        throw std::runtime_error("corrupted hash map snapshot");
+}
+
+// Throws if the offsets do not split the records into consecutive buckets.
+inline void validate_offsets(const uint64_t* offsets, const Header& header) {
+    if (offsets[0] != 0 || offsets[header.bucket_count] != header.size)
+        throw std::runtime_error("corrupted hash map snapshot");
+    for (uint64_t i = 0; i < header.bucket_count; ++i) {
+        if (offsets[i] > offsets[i + 1])
+            throw std::runtime_error("corrupted hash map snapshot");
+    }
+}
+
+// Writes the elements of [begin, end), which must have distinct keys, grouped into buckets.
+template<class KeyType, class ValueType, class Hash, class It>
+void write(const std::string& path, It begin, It end, uint64_t size, const Hash& hasher) {
+    check_types<KeyType, ValueType>();
+    uint64_t bucket_count = PowerOfTwoBucketPolicy::round_capacity(size == 0 ? 1 : size);
+    PowerOfTwoBucketPolicy policy;
+    policy.reset(bucket_count);
+    Header header = make_header<KeyType, ValueType>(size, bucket_count);
+    if constexpr (has_seed<Hash>::value)
+        header.hash_seed = hasher.seed();
+
+    std::vector<uint64_t> offsets(bucket_count + 1, 0);
+    std::vector<uint64_t> buckets;
+    buckets.reserve(size);
+    for (It it = begin; it != end; ++it) {
+        buckets.push_back(policy.index(hasher(it->first)));
+        ++offsets[buckets.back() + 1];
+    }
+    for (uint64_t i = 0; i < bucket_count; ++i)
+        offsets[i + 1] += offsets[i];
+
+    std::vector<uint64_t> positions(offsets.begin(), offsets.end() - 1);
+    std::vector<Record<KeyType, ValueType>> records(size);
+    size_t index = 0;
+    for (It it = begin; it != end; ++it, ++index) {
+        Record<KeyType, ValueType>& record = records[positions[buckets[index]]++];
+        std::memcpy(&record.first, &it->first, sizeof(KeyType));
+        std::memcpy(&record.second, &it->second, sizeof(ValueType));
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("cannot open " + path + " for writing");
+    char padding[kAlignment] = {};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(padding, header.offsets_offset - sizeof(header));
+    out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+    out.write(padding, header.records_offset - header.offsets_offset - offsets.size() * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(records[0]));
+    out.flush();
+    if (!out)
+        throw std::runtime_error("cannot write " + path);
+}
+
+// Reads all the records of a snapshot.
+template<class KeyType, class ValueType>
+std::vector<Record<KeyType, ValueType>> read(const std::string& path) {
+    check_types<KeyType, ValueType>();
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        throw std::runtime_error("cannot open " + path);
+    uint64_t file_size = static_cast<uint64_t>(in.tellg());
+    in.seekg(0);
+    Header header;
+    if (file_size < sizeof(header) || !in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        throw std::runtime_error("not a hash map snapshot");
+    validate<KeyType, ValueType>(header, file_size);
+
+    std::vector<uint64_t> offsets(header.bucket_count + 1);
+    in.seekg(header.offsets_offset);
+    in.read(reinterpret_cast<char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+    std::vector<Record<KeyType, ValueType>> records(header.size);
+    in.seekg(header.records_offset);
+    in.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(records[0]));
+    if (!in)
+        throw std::runtime_error("cannot read " + path);
+    validate_offsets(offsets.data(), header);
+    return records;
+}
+
+}  // namespace snapshot_detail
@@ -0,0 +1,569 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Swiss table flavour of the open addressing map with the same interface as HashMap.
+ * Next to the array of slots there is an array of control bytes, one per slot. A control byte is either
+ * kEmpty, kDeleted (a tombstone), or the 7 lower bits of the element's hash (H2) when the slot is full;
+ * the remaining bits of the hash (H1) choose the group of slots to start probing from.
+ * Lookups load a whole group of control bytes at once (32 with AVX2, 16 with SSE2 and 8 in the portable
+ * version) and compare all of them against H2 with a couple of instructions. Keys are compared only for
+ * slots whose H2 matches, so most lookups, especially unsuccessful ones, never touch key memory. A probe
+ * sequence stops at the first group that has an empty slot. Groups are visited in triangular order, which
+ * covers every group because their number is a power of two.
+ * Elements do not move on erase. Iterators are invalidated only by clear() and by an insertion that rebuilds the
+ * table, which happens when no empty slot may be filled anymore, whether the table then doubles or only drops its
+ * tombstones.
+ */
+
+namespace swiss_detail {
+
+// Any negative control byte means the slot is free.
+constexpr int8_t kEmpty = -128;
+constexpr int8_t kDeleted = -2;
+
+// Set of slots in a group, 2^Shift bits per slot.
+template<int Shift>
+class BitMask {
+public:
+    explicit BitMask(uint64_t mask) : mask_(mask) {}
+
+    explicit operator bool() const {
+        return mask_ != 0;
+    }
+
+    size_t lowest() const {
+        return static_cast<size_t>(__builtin_ctzll(mask_)) >> Shift;
+    }
+
+    void remove_lowest() {
+        mask_ &= mask_ - 1;
+    }
+
+private:
+    uint64_t mask_;
+};
+
+#if defined(__AVX2__)
+
+struct Group {
+    static constexpr size_t kWidth = 32;
+    using Mask = BitMask<0>;
+
+    explicit Group(const int8_t* ctrl) : ctrl_(_mm256_load_si256(reinterpret_cast<const __m256i*>(ctrl))) {}
+
+    Mask match(int8_t h2) const {
+        return Mask(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_set1_epi8(h2), ctrl_))));
+    }
+    Mask match_empty() const {
+        return match(kEmpty);
+    }
+    Mask match_free() const {
+        return Mask(static_cast<uint32_t>(_mm256_movemask_epi8(ctrl_)));
+    }
+
+    __m256i ctrl_;
+};
+
+#elif defined(__SSE2__)
+
+struct Group {
+    static constexpr size_t kWidth = 16;
+    using Mask = BitMask<0>;
+
+    explicit Group(const int8_t* ctrl) : ctrl_(_mm_load_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+
+    Mask match(int8_t h2) const {
+        return Mask(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl_))));
+    }
+    Mask match_empty() const {
+        return match(kEmpty);
+    }
+    Mask match_free() const {
+        return Mask(static_cast<uint16_t>(_mm_movemask_epi8(ctrl_)));
+    }
+
+    __m128i ctrl_;
+};
+
+#else
+
+// Portable version that treats 8 control bytes as one 64-bit word.
+struct Group {
+    static constexpr size_t kWidth = 8;
+    using Mask = BitMask<3>;
+
+    static constexpr uint64_t kLsbs = 0x0101010101010101ull;
+    static constexpr uint64_t kMsbs = 0x8080808080808080ull;
+
+    explicit Group(const int8_t* ctrl) {
+        std::memcpy(&ctrl_, ctrl, sizeof(ctrl_));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        ctrl_ = __builtin_bswap64(ctrl_);
+#endif
+    }
+
+    // May report a false positive next to a true match, which only costs one extra key comparison.
+    Mask match(int8_t h2) const {
+        uint64_t x = ctrl_ ^ (kLsbs * static_cast<uint8_t>(h2));
+        return Mask((x - kLsbs) & ~x & kMsbs);
+    }
+    // kEmpty is the only negative control byte with a zero second bit.
+    Mask match_empty() const {
+        return Mask(ctrl_ & ~(ctrl_ << 6) & kMsbs);
+    }
+    Mask match_free() const {
+        return Mask(ctrl_ & kMsbs);
+    }
+
+    uint64_t ctrl_;
+};
+
+#endif
+
+}  // namespace swiss_detail
+
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType> >
+class SwissHashMap {
+public:
+    using value_type = std::pair<const KeyType, ValueType>;
+
+private:
+    using Group = swiss_detail::Group;
+
+    struct Slot {
+        alignas(value_type) unsigned char storage[sizeof(value_type)];
+
+        value_type* value() {
+            return std::launder(reinterpret_cast<value_type*>(storage));
+        }
+        const value_type* value() const {
+            return std::launder(reinterpret_cast<const value_type*>(storage));
+        }
+    };
+
+    template<bool IsConst>
+    class Iterator {
+        using SlotPointer = typename std::conditional<IsConst, const Slot*, Slot*>::type;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename SwissHashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = typename std::conditional<IsConst, const value_type*, value_type*>::type;
+        using reference = typename std::conditional<IsConst, const value_type&, value_type&>::type;
+
+        Iterator() = default;
+
+        // Every iterator may be turned into a const_iterator.
+        template<bool OtherConst, class = typename std::enable_if<IsConst && !OtherConst>::type>
+        Iterator(const Iterator<OtherConst>& other)
+            : ctrl_(other.ctrl_), ctrl_end_(other.ctrl_end_), slot_(other.slot_) {}
+
+        reference operator*() const {
+            return *slot_->value();
+        }
+        pointer operator->() const {
+            return slot_->value();
+        }
+
+        Iterator& operator++() {
+            ++ctrl_;
+            ++slot_;
+            skip_free();
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return ctrl_ == other.ctrl_;
+        }
+        bool operator!=(const Iterator& other) const {
+            return ctrl_ != other.ctrl_;
+        }
+
+    private:
+        friend class SwissHashMap;
+        template<bool> friend class Iterator;
+
+        Iterator(const int8_t* ctrl, const int8_t* ctrl_end, SlotPointer slot)
+            : ctrl_(ctrl), ctrl_end_(ctrl_end), slot_(slot) {
+            skip_free();
+        }
+
+        void skip_free() {
+            while (ctrl_ != ctrl_end_ && *ctrl_ < 0) {
+                ++ctrl_;
+                ++slot_;
+            }
+        }
+
+        const int8_t* ctrl_ = nullptr;
+        const int8_t* ctrl_end_ = nullptr;
+        SlotPointer slot_ = nullptr;
+    };
+
+public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+private:
+    static constexpr size_t kInitialCapacity = Group::kWidth < 16 ? 16 : Group::kWidth;
+
+    Hash hasher_;
+    int8_t* ctrl_ = nullptr;
+    Slot* slots_ = nullptr;
+    // Capacity is a power of two and a multiple of the group width.
+    size_t capacity_ = 0;
+    size_t num_elements_ = 0;
+    // Number of empty slots that may still be filled before the load reaches 7/8.
+    size_t growth_left_ = 0;
+
+    // Finalizer of MurmurHash3, so that weak hashes still give well distributed H1 and H2.
+    size_t ApplyHash(const KeyType& obj) const {
+        uint64_t hash = static_cast<uint64_t>(hasher_(obj));
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ull;
+        hash ^= hash >> 33;
+        return static_cast<size_t>(hash);
+    }
+
+    static size_t H1(size_t hash) {
+        return hash >> 7;
+    }
+
+    static int8_t H2(size_t hash) {
+        return static_cast<int8_t>(hash & 0x7F);
+    }
+
+    size_t group_mask() const {
+        return capacity_ / Group::kWidth - 1;
+    }
+
+    // Owns the control bytes and the slots of a table that is not installed into the map yet. Both arrays are allocated
+    // by the constructor, so a failed allocation leaves nothing behind.
+    struct TableMemory {
+        explicit TableMemory(size_t count) : capacity(count) {
+            ctrl = static_cast<int8_t*>(::operator new(capacity, std::align_val_t(Group::kWidth)));
+            try {
+                slots = std::allocator<Slot>().allocate(capacity);
+            } catch (...) {
+                ::operator delete(ctrl, std::align_val_t(Group::kWidth));
+                throw;
+            }
+            std::memset(ctrl, static_cast<uint8_t>(swiss_detail::kEmpty), capacity);
+        }
+
+        TableMemory(const TableMemory&) = delete;
+        TableMemory& operator= (const TableMemory&) = delete;
+
+        // Frees the arrays; the elements, if any were built, have to be destroyed before.
+        ~TableMemory() {
+            if (ctrl == nullptr)
+                return;
+            ::operator delete(ctrl, std::align_val_t(Group::kWidth));
+            std::allocator<Slot>().deallocate(slots, capacity);
+        }
+
+        int8_t* ctrl = nullptr;
+        Slot* slots = nullptr;
+        size_t capacity;
+    };
+
+    // Hands the arrays of 'memory' over to the map.
+    void install(TableMemory& memory) {
+        ctrl_ = memory.ctrl;
+        slots_ = memory.slots;
+        capacity_ = memory.capacity;
+        growth_left_ = capacity_ - capacity_ / 8;
+        memory.ctrl = nullptr;
+        memory.slots = nullptr;
+    }
+
+    void InitializeTable(const size_t capacity = kInitialCapacity) {
+        TableMemory memory(capacity);
+        install(memory);
+    }
+
+    void destroy_table() {
+        if (ctrl_ == nullptr)
+            return;
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (ctrl_[i] >= 0)
+                slots_[i].value()->~value_type();
+        }
+        ::operator delete(ctrl_, std::align_val_t(Group::kWidth));
+        std::allocator<Slot>().deallocate(slots_, capacity_);
+        ctrl_ = nullptr;
+        slots_ = nullptr;
+        num_elements_ = 0;
+    }
+
+    // Returns the slot holding the key, or capacity_ if there is no such slot.
+    size_t find_index(const KeyType& key) const {
+        const size_t hash = ApplyHash(key);
+        const int8_t h2 = H2(hash);
+        size_t group = H1(hash) & group_mask();
+        for (size_t step = 1;; ++step) {
+            Group ctrl(ctrl_ + group * Group::kWidth);
+            for (auto match = ctrl.match(h2); match; match.remove_lowest()) {
+                size_t index = group * Group::kWidth + match.lowest();
+                if (slots_[index].value()->first == key)
+                    return index;
+            }
+            if (ctrl.match_empty())
+                return capacity_;
+            group = (group + step) & group_mask();
+        }
+    }
+
+    // Returns the first free slot on the probe sequence of the hash, in the control bytes of a table of 'capacity'
+    // slots.
+    static size_t find_free(const int8_t* ctrl, size_t capacity, size_t hash) {
+        const size_t mask = capacity / Group::kWidth - 1;
+        size_t group = H1(hash) & mask;
+        for (size_t step = 1;; ++step) {
+            auto free = Group(ctrl + group * Group::kWidth).match_free();
+            if (free)
+                return group * Group::kWidth + free.lowest();
+            group = (group + step) & mask;
+        }
+    }
+
+    size_t find_free(size_t hash) const {
+        return find_free(ctrl_, capacity_, hash);
+    }
+
+    // Method that is called when a new element, guaranteed not be in the table, is added.
+    size_t add_to_slots(std::pair<KeyType, ValueType>&& obj) {
+        const size_t hash = ApplyHash(obj.first);
+        size_t index = find_free(hash);
+        new (slots_[index].storage) value_type(std::move(obj));
+        if (ctrl_[index] == swiss_detail::kEmpty)
+            --growth_left_;
+        ctrl_[index] = H2(hash);
+        return index;
+    }
+
+    // Rebuilds the table when no empty slot may be filled anymore. If most of the used-up slots are
+    // tombstones the capacity stays the same, otherwise it doubles.
+    // The new arrays are allocated and filled before the old ones are touched. Elements are moved only if that cannot
+    // throw, and copied otherwise, so if anything throws, the copies are destroyed and the map stays as it was.
+    void try_to_rehash() {
+        if (growth_left_ > 0)
+            return;
+
+        TableMemory fresh(num_elements_ * 16 < capacity_ * 7 ? capacity_ : capacity_ * 2);
+        try {
+            for (size_t i = 0; i < capacity_; ++i) {
+                if (ctrl_[i] < 0)
+                    continue;
+                value_type* old_value = slots_[i].value();
+                const size_t hash = ApplyHash(old_value->first);
+                size_t index = find_free(fresh.ctrl, fresh.capacity, hash);
+                new (fresh.slots[index].storage) value_type(std::move_if_noexcept(*old_value));
+                fresh.ctrl[index] = H2(hash);
+            }
+        } catch (...) {
+            for (size_t i = 0; i < fresh.capacity; ++i) {
+                if (fresh.ctrl[i] >= 0)
+                    fresh.slots[i].value()->~value_type();
+            }
+            throw;
+        }
+
+        // The old elements have been moved or copied from, and go away together with the old arrays.
+        size_t num_elements = num_elements_;
+        destroy_table();
+        install(fresh);
+        num_elements_ = num_elements;
+        growth_left_ -= num_elements_;
+    }
+
+    iterator iterator_at(size_t index) {
+        return iterator(ctrl_ + index, ctrl_ + capacity_, slots_ + index);
+    }
+    const_iterator iterator_at(size_t index) const {
+        return const_iterator(ctrl_ + index, ctrl_ + capacity_, slots_ + index);
+    }
+
+public:
+    explicit SwissHashMap(Hash hasher_obj = Hash()) : hasher_(hasher_obj) {
+        InitializeTable();
+    }
+
+    // Constructors are implemented as a bunch of insertions.
+    template<typename _ForwardIterator>
+    SwissHashMap(_ForwardIterator begin, _ForwardIterator end, Hash hasher_obj = Hash()) : SwissHashMap(hasher_obj) {
+        for (auto it = begin; it != end; ++it) {
+            insert(*it);
+        }
+    }
+
+    SwissHashMap(std::initializer_list<std::pair<KeyType, ValueType>> list,
+                 Hash hasher_obj = Hash()) : SwissHashMap(list.begin(), list.end(), hasher_obj) {}
+
+    // The copy keeps the layout of the source, so no element has to be hashed again.
+    SwissHashMap(const SwissHashMap& other) : hasher_(other.hasher_) {
+        InitializeTable(other.capacity_);
+        try {
+            for (size_t i = 0; i < capacity_; ++i) {
+                if (other.ctrl_[i] < 0)
+                    continue;
+                new (slots_[i].storage) value_type(*other.slots_[i].value());
+                ctrl_[i] = other.ctrl_[i];
+                ++num_elements_;
+            }
+        } catch (...) {
+            destroy_table();
+            throw;
+        }
+        std::memcpy(ctrl_, other.ctrl_, capacity_);
+        growth_left_ = other.growth_left_;
+    }
+
+    SwissHashMap(SwissHashMap&& other)
+        : hasher_(std::move(other.hasher_)), ctrl_(other.ctrl_), slots_(other.slots_), capacity_(other.capacity_),
+          num_elements_(other.num_elements_), growth_left_(other.growth_left_) {
+        other.ctrl_ = nullptr;
+        other.num_elements_ = 0;
+        other.InitializeTable();
+    }
+
+    SwissHashMap& operator= (const SwissHashMap& other) {
+
+        //Anti-self-assignment.
+        if (this == &other)
+            return *this;
+
+        SwissHashMap copy(other);
+        swap(copy);
+        return *this;
+    }
+
+    SwissHashMap& operator= (SwissHashMap&& other) {
+        if (this == &other)
+            return *this;
+
+        swap(other);
+        other.clear();
+        return *this;
+    }
+
+    // Check if table contains the key and do nothing if it does, or add it.
+    iterator insert(std::pair<KeyType, ValueType> obj) {
+        size_t index = find_index(obj.first);
+        if (index != capacity_)
+            return iterator_at(index);
+
+        try_to_rehash();
+        index = add_to_slots(std::move(obj));
+        ++num_elements_;
+        return iterator_at(index);
+    }
+
+    void erase(const KeyType& to_delete) {
+        size_t index = find_index(to_delete);
+        if (index == capacity_)
+            return;
+
+        slots_[index].value()->~value_type();
+        --num_elements_;
+        // A probe sequence never went past a group that still has an empty slot, so such a group
+        // does not need a tombstone.
+        size_t group = index - index % Group::kWidth;
+        if (Group(ctrl_ + group).match_empty()) {
+            ctrl_[index] = swiss_detail::kEmpty;
+            ++growth_left_;
+        } else {
+            ctrl_[index] = swiss_detail::kDeleted;
+        }
+    }
+
+    iterator find(const KeyType& key) {
+        return iterator_at(find_index(key));
+    }
+
+    const_iterator find(const KeyType& key) const {
+        return iterator_at(find_index(key));
+    }
+
+    ValueType& operator[](const KeyType& key) {
+        auto iter = find(key);
+        if (iter == end()) {
+            // Insert default value if an element was not found.
+            iter = insert({key, ValueType()});
+        }
+        return iter->second;
+    }
+
+    const ValueType& at(const KeyType& key) const {
+        const_iterator iter = find(key);
+        if (iter == end())
+            throw std::out_of_range("no such element");
+        return iter->second;
+    }
+
+    void clear() {
+        destroy_table();
+        InitializeTable();
+    }
+
+    void swap(SwissHashMap& other) noexcept {
+        std::swap(hasher_, other.hasher_);
+        std::swap(ctrl_, other.ctrl_);
+        std::swap(slots_, other.slots_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(num_elements_, other.num_elements_);
+        std::swap(growth_left_, other.growth_left_);
+    }
+
+    Hash hash_function() const {
+        return hasher_;
+    }
+
+    size_t size() const {
+        return num_elements_;
+    }
+
+    bool empty() const {
+        return num_elements_ == 0;
+    }
+
+    iterator begin() {
+        return iterator_at(0);
+    }
+    iterator end() {
+        return iterator_at(capacity_);
+    }
+    const_iterator begin() const {
+        return iterator_at(0);
+    }
+    const_iterator end() const {
+        return iterator_at(capacity_);
+    }
+
+    ~SwissHashMap() {
+        destroy_table();
+    }
+};
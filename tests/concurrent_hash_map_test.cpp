@@ -0,0 +1,39 @@
+#include "concurrent_hash_map.h"
+#include "test_support.h"
+
+/**
+ * ConcurrentHashMap: writers on disjoint key ranges, checked for the final contents.
+ */
+
+using test_support::kKeysPerThread;
+using test_support::kThreads;
+using test_support::run_threads;
+
+namespace {
+
+void test_concurrent() {
+    ConcurrentHashMap<int, int> map(8);
+    run_threads([&map](int t) {
+        for (int i = t * kKeysPerThread; i < (t + 1) * kKeysPerThread; ++i) {
+            CHECK(map.insert({i, i}));
+            CHECK(!map.insert({i, -i}));
+            map.upsert(i, [](int& value) { value *= 2; });
+            if (i % 3 == 0)
+                CHECK(map.erase(i));
+        }
+    });
+    CHECK(map.size() == static_cast<size_t>(kThreads * kKeysPerThread - (kThreads * kKeysPerThread + 2) / 3));
+    for (int i = 0; i < kThreads * kKeysPerThread; ++i) {
+        auto value = map.find(i);
+        CHECK(i % 3 == 0 ? !value : value && *value == 2 * i);
+    }
+    map.clear();
+    CHECK(map.empty());
+}
+
+}  // namespace
+
+int main() {
+    test_concurrent();
+    return 0;
+}
@@ -0,0 +1,40 @@
+#include "dense_hash_map.h"
+#include "test_support.h"
+
+/**
+ * DenseHashMap: a random mix of operations checked against std::map, with copies and moves, and the state left
+ * behind by an exception during an erase.
+ */
+
+using test_support::check_intact;
+using test_support::FailAfter;
+using test_support::InjectedFailure;
+using test_support::test_round_trip;
+using test_support::Throwing;
+
+namespace {
+
+// A throwing move of the last element into the erased slot leaves every element where it was.
+void test_erase_exception() {
+    DenseHashMap<int, Throwing> map;
+    for (int i = 0; i < 4; ++i)
+        map.insert({i, Throwing(i)});
+    {
+        FailAfter failure(0);
+        CHECK_THROWS(map.erase(0), InjectedFailure);
+    }
+    check_intact(map, 4);
+
+    map.erase(0);
+    CHECK(map.size() == 3 && map.find(0) == map.end());
+    for (int i = 1; i < 4; ++i)
+        CHECK(map.find(i)->second.value() == i);
+}
+
+}  // namespace
+
+int main() {
+    test_round_trip<DenseHashMap<int, int>>(3000);
+    test_erase_exception();
+    return 0;
+}
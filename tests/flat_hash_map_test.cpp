@@ -0,0 +1,20 @@
+#include "flat_hash_map.h"
+#include "test_support.h"
+
+/**
+ * FlatHashMap with linear and Robin Hood probing: a random mix of operations checked against std::map, with copies
+ * and moves, and the state left behind by an exception during a rehash.
+ */
+
+using test_support::test_rehash_exception;
+using test_support::test_round_trip;
+using test_support::Throwing;
+
+int main() {
+    test_round_trip<FlatHashMap<int, int>>(3000);
+    test_round_trip<FlatHashMap<int, int, std::hash<int>, RobinHoodProbing>>(3000);
+
+    test_rehash_exception<FlatHashMap<int, Throwing>>(5);
+    test_rehash_exception<FlatHashMap<int, Throwing, std::hash<int>, RobinHoodProbing>>(5);
+    return 0;
+}
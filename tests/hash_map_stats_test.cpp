@@ -0,0 +1,81 @@
+#include <cstddef>
+#include <vector>
+
+#include "hash_map.h"
+#include "test_support.h"
+
+/**
+ * HashMap::stats() with the counters of HASH_MAP_ENABLE_STATS compiled in, which the build defines for this test
+ * only: find hits and misses, rehashes and their time, and the chain length histogram.
+ */
+
+static_assert(HASH_MAP_ENABLE_STATS, "the stats test is built with HASH_MAP_ENABLE_STATS=1");
+
+namespace {
+
+// Sends every key to one bucket. It cannot be reseeded, and the test keeps its chain below kMaxChainLength.
+struct ZeroHash {
+    size_t operator()(int) const {
+        return 0;
+    }
+};
+
+void test_counters() {
+    HashMap<int, int> map;
+    for (int i = 0; i < 1000; ++i)
+        map[i] = i;
+    CHECK(map.stats().rehash_count > 0);
+
+    map.reset_stats();
+    HashMapStats stats = map.stats();
+    CHECK(stats.rehash_count == 0 && stats.rehash_time.count() == 0);
+    CHECK(stats.find_hits == 0 && stats.find_misses == 0);
+
+    for (int i = 0; i < 1500; ++i)
+        map.find(i);
+    std::vector<int> keys = {1, 2000, 3, 4000};
+    std::vector<bool> contained(keys.size());
+    map.contains_batch(keys.begin(), keys.end(), contained.begin());
+    stats = map.stats();
+    CHECK(stats.find_hits == 1002 && stats.find_misses == 502);
+
+    map.rehash(map.bucket_count() * 4);
+    stats = map.stats();
+    CHECK(stats.rehash_count == 1 && stats.rehash_time.count() > 0);
+}
+
+void test_chain_lengths() {
+    HashMap<int, int> empty;
+    HashMapStats stats = empty.stats();
+    CHECK(stats.max_chain_length == 0 && stats.chain_lengths.size() == 1);
+    CHECK(stats.chain_lengths[0] == empty.bucket_count());
+
+    HashMap<int, int, ZeroHash> colliding;
+    for (int i = 0; i < 20; ++i)
+        colliding[i] = i;
+    stats = colliding.stats();
+    CHECK(stats.max_chain_length == 20 && stats.chain_lengths.size() == 21);
+    CHECK(stats.chain_lengths[20] == 1 && stats.chain_lengths[0] == colliding.bucket_count() - 1);
+
+    HashMap<int, int> map;
+    for (int i = 0; i < 5000; ++i)
+        map[i * 7] = i;
+    stats = map.stats();
+    size_t buckets = 0;
+    size_t elements = 0;
+    for (size_t length = 0; length < stats.chain_lengths.size(); ++length) {
+        buckets += stats.chain_lengths[length];
+        elements += length * stats.chain_lengths[length];
+    }
+    CHECK(buckets == map.bucket_count() && elements == map.size());
+    CHECK(stats.max_chain_length + 1 == stats.chain_lengths.size() && stats.chain_lengths.back() > 0);
+    CHECK(stats.bytes_allocated > empty.stats().bytes_allocated);
+}
+
+}  // namespace
+
+int main() {
+    test_counters();
+    test_chain_lengths();
+    return 0;
+}
@@ -0,0 +1,407 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "hash_map.h"
+#include "pool_allocator.h"
+#include "test_support.h"
+
+/**
+ * HashMap: random mixes of operations checked against std::map, with copies and moves, and checks of the features
+ * that need more than that.
+ */
+
+// Counts heap allocations, so that a test can tell whether a lookup built a std::string.
+static std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size) {
+    ++allocations;
+    if (void* memory = std::malloc(size != 0 ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+using test_support::check_against;
+using test_support::FailAfter;
+using test_support::InjectedFailure;
+using test_support::Throwing;
+
+namespace {
+
+// Runs a random mix of operations on the map and on a std::map, then checks that the map, a copy of it and a moved
+// copy hold the same elements.
+template<class Map>
+void random_operations(Map& map) {
+    std::map<int, int> expected;
+    std::mt19937 random(1);
+    for (int step = 0; step < 100000; ++step) {
+        int key = static_cast<int>(random() % 4000);
+        switch (random() % 5) {
+        case 0:
+        case 1:
+            map.insert({key, step});
+            expected.insert({key, step});
+            break;
+        case 2:
+            map.insert_or_assign(key, step);
+            expected[key] = step;
+            break;
+        case 3:
+            map.erase(key);
+            expected.erase(key);
+            break;
+        default:
+            auto iter = map.find(key);
+            if (iter != map.end()) {
+                map.erase(iter);
+                expected.erase(key);
+            }
+        }
+    }
+    check_against(map, expected);
+
+    Map copy(map);
+    check_against(copy, expected);
+    CHECK(std::equal(map.begin(), map.end(), copy.begin(), copy.end()));
+    Map moved(std::move(copy));
+    check_against(moved, expected);
+    CHECK(copy.empty());
+    copy.insert({1, 1});
+    CHECK(copy.size() == 1);
+}
+
+void test_round_trip() {
+    HashMap<int, int> map;
+    random_operations(map);
+    HashMap<int, int> incremental;
+    incremental.set_incremental_rehash(true);
+    random_operations(incremental);
+    // The old buckets are moved faster the sparser the table is, and slower the denser it is.
+    HashMap<int, int> sparse;
+    sparse.max_load_factor(0.1f);
+    sparse.set_incremental_rehash(true);
+    random_operations(sparse);
+    HashMap<int, int> dense;
+    dense.max_load_factor(4.0f);
+    dense.set_incremental_rehash(true);
+    random_operations(dense);
+    HashMap<int, int, std::hash<int>, std::equal_to<int>, PoolAllocator<std::pair<const int, int>>> pooled;
+    pooled.set_incremental_rehash(true);
+    random_operations(pooled);
+}
+
+using PrimeMap = HashMap<int, int, std::hash<int>, std::equal_to<int>, std::allocator<std::pair<const int, int>>, false,
+                         PrimeBucketPolicy>;
+
+bool is_prime(size_t number) {
+    if (number < 2)
+        return false;
+    for (size_t divisor = 2; divisor * divisor <= number; ++divisor) {
+        if (number % divisor == 0)
+            return false;
+    }
+    return true;
+}
+
+// PrimeBucketPolicy through growth, incremental rehashing and shrinking, which all keep the bucket count prime.
+void test_prime_buckets() {
+    PrimeMap map;
+    random_operations(map);
+    PrimeMap incremental;
+    incremental.set_incremental_rehash(true);
+    incremental.min_load_factor(0.1f);
+    random_operations(incremental);
+
+    PrimeMap shrinking;
+    shrinking.set_incremental_rehash(true);
+    shrinking.min_load_factor(0.1f);
+    std::map<int, int> expected;
+    for (int i = 0; i < 10000; ++i) {
+        shrinking[i] = i;
+        expected[i] = i;
+        CHECK(is_prime(shrinking.bucket_count()));
+    }
+    size_t grown = shrinking.bucket_count();
+    for (int i = 100; i < 10000; ++i) {
+        shrinking.erase(i);
+        expected.erase(i);
+        CHECK(is_prime(shrinking.bucket_count()));
+    }
+    check_against(shrinking, expected);
+    CHECK(shrinking.bucket_count() < grown / 10);
+
+    shrinking.min_load_factor(0);
+    shrinking.rehash(grown);
+    shrinking.shrink_to_fit();
+    CHECK(is_prime(shrinking.bucket_count()) && shrinking.bucket_count() < grown / 10);
+    check_against(shrinking, expected);
+}
+
+void test_node_handles() {
+    HashMap<std::string, int> source;
+    HashMap<std::string, int> target;
+    for (int i = 0; i < 1000; ++i)
+        source[std::to_string(i)] = i;
+    auto node = source.extract("7");
+    CHECK(node && node.key() == "7" && node.mapped() == 7);
+    CHECK(target.insert(std::move(node)).inserted);
+    target["8"] = -8;
+    target.merge(source);
+    CHECK(target.size() == 1000 && source.size() == 1);
+    CHECK(source.find("8") != source.end() && target.at("8") == -8);
+}
+
+// A large range inserted into an empty map is built in parallel, also while an incremental rehash is pending: the
+// growth at 131073 elements leaves most of the old buckets in place and the range fits without another one.
+void test_parallel_build() {
+    HashMap<int, int> map;
+    map.set_incremental_rehash(true);
+    for (int i = 0; i < 140000; ++i)
+        map[i] = i;
+    map.erase_if([](const std::pair<const int, int>&) { return true; });
+    CHECK(map.empty());
+
+    std::vector<std::pair<int, int>> elements;
+    std::mt19937 random(3);
+    for (int i = 0; i < 100000; ++i)
+        elements.emplace_back(static_cast<int>(random()), i);
+    map.insert(elements.begin(), elements.end());
+    std::map<int, int> expected(elements.begin(), elements.end());
+    check_against(map, expected);
+}
+
+// A low-water mark makes a mass erase give back buckets, shrink_to_fit() does it on request, and a mark that the
+// table would oscillate around is refused.
+void test_shrink() {
+    HashMap<int, int> map;
+    CHECK_THROWS(map.min_load_factor(-0.1f), std::invalid_argument);
+    CHECK_THROWS(map.min_load_factor(map.max_load_factor() / 2), std::invalid_argument);
+    map.min_load_factor(0.1f);
+    for (int i = 0; i < 10000; ++i)
+        map[i] = i;
+    size_t grown = map.bucket_count();
+    for (int i = 0; i < 9900; ++i)
+        map.erase(i);
+    CHECK(map.bucket_count() <= 1024 && map.load_factor() <= map.max_load_factor());
+    for (int i = 9900; i < 10000; ++i)
+        CHECK(map.at(i) == i);
+
+    // Without the mark, erasing keeps the buckets until shrink_to_fit().
+    HashMap<int, int> kept;
+    for (int i = 0; i < 10000; ++i)
+        kept[i] = i;
+    for (int i = 0; i < 9900; ++i)
+        kept.erase(i);
+    CHECK(kept.bucket_count() == grown);
+    kept.shrink_to_fit();
+    CHECK(kept.bucket_count() == 256);
+    for (int i = 9900; i < 10000; ++i)
+        CHECK(kept.at(i) == i);
+
+    // A smaller max load factor turns off a mark that no longer fits below half of it.
+    map.max_load_factor(0.15f);
+    CHECK(map.min_load_factor() == 0);
+}
+
+// With a transparent hasher and key comparison, find, at, operator[] and erase take std::string_view and const char*
+// keys as they are: none of them allocates a std::string unless operator[] has to insert the key.
+void test_transparent_lookups() {
+    HashMap<std::string, int, StringHash, std::equal_to<>> map;
+    std::vector<std::string> keys;
+    for (int i = 0; i < 100; ++i) {
+        // Longer than any small string buffer, so a std::string made of one has to allocate.
+        keys.push_back("transparent-lookup-key-" + std::to_string(i));
+        map[keys.back()] = i;
+    }
+
+    size_t before = allocations;
+    for (int i = 0; i < 100; ++i) {
+        std::string_view view = keys[i];
+        const char* chars = keys[i].c_str();
+        CHECK(map.find(view) != map.end() && map.find(view)->second == i);
+        CHECK(map.at(chars) == i);
+        map[view] += 1;
+        CHECK(map.at(view) == i + 1);
+        if (i % 2 == 0)
+            map.erase(chars);
+    }
+    CHECK(map.find(std::string_view("transparent-lookup-key-missing")) == map.end());
+    CHECK(allocations == before);
+    CHECK_THROWS(map.at("transparent-lookup-key-missing"), std::out_of_range);
+
+    CHECK(map.size() == 50 && map.find(keys[0]) == map.end() && map.at(keys[1]) == 2);
+    before = allocations;
+    map[std::string_view("transparent-lookup-key-new")] = 7;
+    CHECK(allocations > before && map.at(std::string("transparent-lookup-key-new")) == 7);
+}
+
+// Counts its copies and moves.
+struct Counted {
+    static inline int copies = 0;
+    static inline int moves = 0;
+
+    explicit Counted(int value = 0) : value(value) {}
+
+    Counted(const Counted& other) : value(other.value) {
+        ++copies;
+    }
+
+    Counted(Counted&& other) noexcept : value(other.value) {
+        ++moves;
+    }
+
+    int value;
+};
+
+// emplace, try_emplace and rvalue insert work with move-only values, never copy, and leave their arguments alone
+// when the key is in the table already.
+void test_move_aware_insert() {
+    HashMap<int, std::unique_ptr<int>> map;
+    CHECK(map.emplace(1, std::make_unique<int>(1)).second);
+    auto value = std::make_unique<int>(2);
+    CHECK(!map.try_emplace(1, std::move(value)).second && value != nullptr && *map.at(1) == 1);
+    CHECK(map.try_emplace(2, std::move(value)).second && value == nullptr && *map.at(2) == 2);
+    std::pair<const int, std::unique_ptr<int>> element(1, std::make_unique<int>(3));
+    CHECK(!map.emplace(std::move(element)).second && element.second != nullptr);
+    map.insert(std::pair<const int, std::unique_ptr<int>>(3, std::make_unique<int>(3)));
+    map.insert_or_assign(1, std::make_unique<int>(10));
+    CHECK(map.size() == 3 && *map.at(1) == 10 && *map.at(3) == 3);
+
+    HashMap<std::string, Counted> counted;
+    std::string key = "a key too long for the small string buffer";
+    counted.try_emplace(key, 1);
+    CHECK(Counted::copies == 0 && Counted::moves == 0);
+    std::string moved_key = key;
+    CHECK(!counted.try_emplace(std::move(moved_key), 2).second && moved_key == key);
+    counted.emplace("two", Counted(2));
+    counted.insert({"three", Counted(3)});
+    Counted four(4);
+    CHECK(counted.try_emplace("four", std::move(four)).second);
+    CHECK(!counted.try_emplace("four", std::move(four)).second);
+    // One move each into emplace and try_emplace, and two for the pair of insert: into the pair and out of it.
+    CHECK(Counted::copies == 0 && Counted::moves == 4);
+    CHECK(counted.size() == 4 && counted.at("four").value == 4);
+}
+
+// find_batch and contains_batch agree with find on groups of more than kBatchSize keys, hits and misses mixed, for
+// every size from empty to a few thousand elements. The map rehashes incrementally and is read through a const
+// reference, which takes no rehash step, so most sizes are looked up in the middle of a rehash.
+void test_batch_lookups() {
+    HashMap<int, int> map;
+    map.set_incremental_rehash(true);
+    const HashMap<int, int>& view = map;
+    std::vector<int> keys(40);
+    std::vector<HashMap<int, int>::iterator> found(keys.size());
+    std::vector<HashMap<int, int>::const_iterator> const_found(keys.size());
+    std::vector<bool> contained(keys.size());
+    for (int size = 0; size <= 3000; ++size) {
+        // Even keys below 2 * size are in the map, odd ones never are.
+        for (size_t i = 0; i < keys.size(); ++i)
+            keys[i] = static_cast<int>((i * 37 + size) % (2 * size + 4));
+        view.find_batch(keys.begin(), keys.end(), const_found.begin());
+        view.contains_batch(keys.begin(), keys.end(), contained.begin());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            bool hit = keys[i] % 2 == 0 && keys[i] < 2 * size;
+            CHECK(const_found[i] == view.find(keys[i]) && contained[i] == hit);
+            CHECK(!hit || const_found[i]->second == keys[i] / 2);
+        }
+        map.find_batch(keys.begin(), keys.end(), found.begin());
+        for (size_t i = 0; i < keys.size(); ++i)
+            CHECK(found[i] == map.find(keys[i]));
+        map[2 * size] = size;
+    }
+}
+
+// Sends every key to one bucket and counts how often the map asks it for a new seed.
+struct ConstantHash {
+    static inline int reseeds = 0;
+
+    size_t operator()(int) const {
+        return 0;
+    }
+
+    void reseed() {
+        ++reseeds;
+    }
+};
+
+// Keys whose full hashes collide stay findable and make the map reseed at most once per capacity, not on every
+// insertion into the overlong chain. With SeededHash, chains grown past kMaxChainLength by a high load factor give
+// the hasher a new seed, and every key is found under it.
+void test_reseed() {
+    HashMap<int, int, ConstantHash> colliding;
+    for (int i = 0; i < 2000; ++i)
+        colliding[i] = i;
+    CHECK(ConstantHash::reseeds > 0 && ConstantHash::reseeds <= 16);
+    for (int i = 0; i < 2000; ++i)
+        CHECK(colliding.at(i) == i);
+
+    HashMap<std::string, int, SeededHash, std::equal_to<>> seeded;
+    seeded.max_load_factor(64.0f);
+    HashSeed first_seed = seeded.hash_function().seed();
+    for (int i = 0; i < 5000; ++i)
+        seeded[std::to_string(i)] = i;
+    HashSeed seed = seeded.hash_function().seed();
+    CHECK(seed.k0 != first_seed.k0 || seed.k1 != first_seed.k1);
+    for (int i = 0; i < 5000; ++i)
+        CHECK(seeded.at(std::to_string(i)) == i);
+
+    // Every map, and every SeededHash, draws a seed of its own.
+    HashMap<std::string, int, SeededHash, std::equal_to<>> other;
+    HashSeed other_seed = other.hash_function().seed();
+    CHECK(other_seed.k0 != first_seed.k0 && other_seed.k1 != first_seed.k1);
+}
+
+// A value that fails to be copied in leaves the map as it was.
+void test_insert_exception() {
+    HashMap<int, Throwing> map;
+    for (int i = 0; i < 100; ++i)
+        map.insert({i, Throwing(i)});
+    {
+        std::pair<const int, Throwing> obj(1000, Throwing(1000));
+        FailAfter failure(0);
+        CHECK_THROWS(map.insert(obj), InjectedFailure);
+    }
+    CHECK(map.size() == 100 && map.find(1000) == map.end());
+    for (int i = 0; i < 100; ++i)
+        CHECK(map.find(i)->second.value() == i);
+
+    {
+        FailAfter failure(50);
+        CHECK_THROWS((HashMap<int, Throwing>(map)), InjectedFailure);
+    }
+    HashMap<int, Throwing> copy(map);
+    CHECK(copy.size() == 100 && copy.find(99)->second.value() == 99);
+}
+
+}  // namespace
+
+int main() {
+    test_round_trip();
+    test_prime_buckets();
+    test_shrink();
+    test_node_handles();
+    test_transparent_lookups();
+    test_move_aware_insert();
+    test_parallel_build();
+    test_batch_lookups();
+    test_reseed();
+    test_insert_exception();
+    return 0;
+}
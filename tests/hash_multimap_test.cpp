@@ -0,0 +1,25 @@
+#include "hash_multimap.h"
+#include "test_support.h"
+
+/**
+ * HashMultiMap: repeated keys, count, equal_range and range erase.
+ */
+
+namespace {
+
+void test_multimap() {
+    HashMultiMap<int, int> multimap;
+    for (int i = 0; i < 1000; ++i)
+        multimap.insert({i % 10, i});
+    CHECK(multimap.size() == 1000 && multimap.count(3) == 100);
+    auto range = multimap.equal_range(3);
+    multimap.erase(range.first, range.second);
+    CHECK(multimap.size() == 900 && multimap.count(3) == 0);
+}
+
+}  // namespace
+
+int main() {
+    test_multimap();
+    return 0;
+}
@@ -0,0 +1,27 @@
+#include <string>
+
+#include "hash_set.h"
+#include "test_support.h"
+
+/**
+ * HashSet: repeated insertions, lookups, copies and range erase.
+ */
+
+namespace {
+
+void test_set() {
+    HashSet<std::string> set;
+    for (int i = 0; i < 1000; ++i)
+        set.insert(std::to_string(i % 500));
+    CHECK(set.size() == 500 && set.find("499") != set.end() && set.find("500") == set.end());
+    HashSet<std::string> set_copy(set);
+    set.erase(set.begin(), set.end());
+    CHECK(set.empty() && set_copy.size() == 500);
+}
+
+}  // namespace
+
+int main() {
+    test_set();
+    return 0;
+}
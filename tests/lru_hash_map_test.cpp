@@ -0,0 +1,106 @@
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "lru_hash_map.h"
+#include "test_support.h"
+
+/**
+ * LruHashMap: eviction of the least recently used element, copies that keep the recency order, and expiry driven by
+ * a clock the test sets by hand.
+ */
+
+namespace {
+
+void test_lru() {
+    LruHashMap<int, std::string> cache(3);
+    cache.insert_or_assign(1, "one");
+    cache.insert_or_assign(2, "two");
+    cache.insert_or_assign(3, "three");
+    CHECK(cache.find(1) != nullptr);
+    cache.insert_or_assign(4, "four");
+    CHECK(cache.size() == 3 && !cache.contains(2) && cache.contains(1));
+
+    LruHashMap<int, std::string> copy(cache);
+    std::vector<int> order;
+    copy.for_each([&order](int key, const std::string&) { order.push_back(key); });
+    CHECK((order == std::vector<int>{4, 1, 3}));
+}
+
+// Lowering the bound evicts the least recently used elements at once; peek does not make an element more recent.
+void test_max_size() {
+    LruHashMap<int, int> cache(5);
+    for (int i = 0; i < 5; ++i)
+        cache.insert_or_assign(i, i);
+    CHECK(cache.find(0) != nullptr && cache.peek(1) != nullptr);
+    cache.max_size(2);
+    CHECK(cache.size() == 2 && cache.max_size() == 2);
+    CHECK(cache.contains(0) && cache.contains(4) && !cache.contains(1));
+    CHECK_THROWS(cache.max_size(0), std::invalid_argument);
+    CHECK_THROWS((LruHashMap<int, int>(0)), std::invalid_argument);
+}
+
+// Time stands still until the test moves it.
+struct FakeClock {
+    using duration = std::chrono::milliseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<FakeClock>;
+    static constexpr bool is_steady = true;
+
+    static inline time_point current{};
+
+    static time_point now() {
+        return current;
+    }
+
+    static void advance(duration by) {
+        current += by;
+    }
+};
+
+using Cache = LruHashMap<int, int, std::hash<int>, std::equal_to<int>, FakeClock>;
+using std::chrono::milliseconds;
+
+void test_expiry() {
+    Cache cache(10, milliseconds(100));
+    CHECK(cache.ttl() == milliseconds(100));
+    cache.insert_or_assign(1, 1);
+    cache.insert_or_assign(2, 2);
+    FakeClock::advance(milliseconds(50));
+    CHECK(cache.find(1) != nullptr);
+    // Assigning restarts the time to live.
+    cache.insert_or_assign(2, 20);
+
+    // An expired element is a miss for peek and contains, which leave it in place, and for find, which erases it.
+    FakeClock::advance(milliseconds(60));
+    CHECK(cache.peek(1) == nullptr && !cache.contains(1) && cache.size() == 2);
+    CHECK(cache.find(1) == nullptr && cache.size() == 1);
+    CHECK(cache.find(2) != nullptr && *cache.find(2) == 20);
+
+    // A time to live per insertion, zero meaning forever, overrides the one of the cache.
+    cache.insert_or_assign(3, 3, milliseconds(500));
+    cache.insert_or_assign(4, 4, milliseconds(0));
+    cache.insert_or_assign(5, 5);
+    FakeClock::advance(milliseconds(200));
+    std::vector<int> alive;
+    cache.for_each([&alive](int key, int) { alive.push_back(key); });
+    CHECK((alive == std::vector<int>{4, 3}));
+    CHECK(cache.size() == 4 && cache.purge_expired() == 2 && cache.size() == 2);
+    FakeClock::advance(milliseconds(400));
+    CHECK(cache.purge_expired() == 1 && cache.size() == 1 && cache.contains(4));
+    FakeClock::advance(std::chrono::hours(24 * 365));
+    CHECK(cache.purge_expired() == 0 && cache.find(4) != nullptr);
+
+    CHECK_THROWS(Cache(10, milliseconds(-1)), std::invalid_argument);
+}
+
+}  // namespace
+
+int main() {
+    test_lru();
+    test_max_size();
+    test_expiry();
+    return 0;
+}
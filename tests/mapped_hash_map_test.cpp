@@ -0,0 +1,78 @@
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+#include "hash_map.h"
+#include "mapped_hash_map.h"
+#include "test_support.h"
+
+/**
+ * Snapshots written by HashMap and read back by load() and by MappedHashMap, also with a seeded hasher, and a file
+ * that is not a snapshot.
+ */
+
+namespace {
+
+void test_snapshot() {
+    auto path = (std::filesystem::temp_directory_path() / "hash_table_read_only_test.snapshot").string();
+    HashMap<uint64_t, uint64_t> map;
+    for (uint64_t i = 0; i < 10000; ++i)
+        map[i * 31] = i;
+    map.save(path);
+
+    HashMap<uint64_t, uint64_t> loaded;
+    loaded.load(path);
+    CHECK(loaded.size() == map.size());
+    for (auto &el : map)
+        CHECK(loaded.at(el.first) == el.second);
+
+    {
+        MappedHashMap<uint64_t, uint64_t> mapped(path);
+        CHECK(mapped.size() == map.size());
+        for (auto &el : map)
+            CHECK(mapped.at(el.first) == el.second);
+        CHECK(mapped.find(1) == mapped.end());
+    }
+
+    // A file that is not a snapshot is refused.
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    CHECK(file != nullptr);
+    std::fputs("not a snapshot", file);
+    std::fclose(file);
+    CHECK_THROWS((MappedHashMap<uint64_t, uint64_t>(path)), std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+// The seed of a SeededHash travels in the snapshot header: MappedHashMap hashes with it, whatever seed its own hasher
+// started with, and load() rehashes under the seed of the loading map.
+void test_seeded_snapshot() {
+    auto path = (std::filesystem::temp_directory_path() / "hash_table_seeded_test.snapshot").string();
+    HashMap<uint64_t, uint64_t, SeededHash> map;
+    for (uint64_t i = 0; i < 10000; ++i)
+        map[i * 31] = i;
+    map.save(path);
+
+    HashMap<uint64_t, uint64_t, SeededHash> loaded;
+    loaded.load(path);
+    CHECK(loaded.size() == map.size());
+    for (auto &el : map)
+        CHECK(loaded.at(el.first) == el.second);
+
+    {
+        MappedHashMap<uint64_t, uint64_t, SeededHash> mapped(path);
+        CHECK(mapped.size() == map.size());
+        for (auto &el : map)
+            CHECK(mapped.at(el.first) == el.second);
+        CHECK(mapped.find(1) == mapped.end());
+    }
+    std::filesystem::remove(path);
+}
+
+}  // namespace
+
+int main() {
+    test_snapshot();
+    test_seeded_snapshot();
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "perfect_hash_map.h"
+#include "test_support.h"
+
+/**
+ * The perfect hash maps: FixedHashMap built at compile time and PerfectHashMap built at run time.
+ */
+
+namespace {
+
+constexpr auto kFixed = make_fixed_hash_map<std::string_view, int>({{"one", 1}, {"two", 2}, {"three", 3}});
+static_assert(kFixed.at("two") == 2, "a constexpr map is usable at compile time");
+static_assert(!kFixed.contains("four"), "a constexpr map is usable at compile time");
+
+void test_perfect() {
+    std::vector<std::pair<const uint64_t, uint64_t>> elements;
+    for (uint64_t i = 0; i < 10000; ++i)
+        elements.emplace_back(i * 7919, i);
+    PerfectHashMap<uint64_t, uint64_t> map(elements.begin(), elements.end());
+    CHECK(map.size() == elements.size());
+    for (auto &el : elements)
+        CHECK(map.at(el.first) == el.second);
+    CHECK(!map.contains(1) && map.find(1) == map.end());
+    CHECK_THROWS(map.at(1), std::out_of_range);
+
+    std::vector<std::pair<const uint64_t, uint64_t>> repeated = {{1, 1}, {1, 2}};
+    CHECK_THROWS((PerfectHashMap<uint64_t, uint64_t>(repeated.begin(), repeated.end())), std::invalid_argument);
+}
+
+}  // namespace
+
+int main() {
+    test_perfect();
+    return 0;
+}
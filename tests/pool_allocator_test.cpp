@@ -0,0 +1,154 @@
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "hash_map.h"
+#include "page_memory.h"
+#include "pool_allocator.h"
+#include "test_support.h"
+
+/**
+ * PoolAllocator: HashMap dropping its nodes with the arena in clear() and in its destructor, and only when it may;
+ * arenas built with PageOptions, and the mappings of page_memory.h under them. Machines without a
+ * reserved hugetlbfs pool, the usual case and the one of CI, cannot serve MAP_HUGETLB, so kHuge2M and kHuge1G go
+ * through the fallback to transparent huge pages there; the checks hold on either path.
+ */
+
+using test_support::check_against;
+
+namespace {
+
+constexpr size_t kHugePage = size_t(2) << 20;
+
+PageOptions with_pages(PageSize page_size) {
+    PageOptions options;
+    options.page_size = page_size;
+    return options;
+}
+
+// Mappings take whole pages, 1 GiB pages only from a gigabyte up.
+void test_mapped_bytes() {
+    size_t page = page_bytes(PageOptions());
+    CHECK(mapped_bytes(1, PageOptions()) == page);
+    CHECK(mapped_bytes(1, with_pages(PageSize::kTransparentHuge)) == kHugePage);
+    CHECK(mapped_bytes(kHugePage + 1, with_pages(PageSize::kHuge2M)) == 2 * kHugePage);
+    CHECK(mapped_bytes(kHugePage + 1, with_pages(PageSize::kHuge1G)) == 2 * kHugePage);
+    CHECK(mapped_bytes(size_t(1) << 30, with_pages(PageSize::kHuge1G)) == size_t(1) << 30);
+}
+
+// Every page size and NUMA policy gives zeroed, writable memory, huge pages at a 2 MiB boundary, whether the
+// hugetlbfs pool had pages or the mapping fell back.
+void test_map_pages() {
+    for (PageSize page_size : {PageSize::kDefault, PageSize::kTransparentHuge, PageSize::kHuge2M, PageSize::kHuge1G}) {
+        for (NumaPolicy numa : {NumaPolicy::kDefault, NumaPolicy::kInterleave, NumaPolicy::kBind}) {
+            PageOptions options = with_pages(page_size);
+            options.numa = numa;
+            options.nodes = numa == NumaPolicy::kBind ? 1 : 0;
+            size_t bytes = 3 << 20;
+            auto memory = static_cast<unsigned char*>(map_pages(bytes, options));
+            if (page_size != PageSize::kDefault)
+                CHECK(reinterpret_cast<uintptr_t>(memory) % kHugePage == 0);
+            CHECK(memory[0] == 0 && memory[bytes - 1] == 0);
+            std::memset(memory, 0xAB, bytes);
+            CHECK(memory[bytes / 2] == 0xAB);
+            unmap_pages(memory, bytes, options);
+        }
+    }
+}
+
+// A map on a kHuge1G arena works like any other and reserves 2 MiB slabs, not gigabytes.
+void test_huge_page_map() {
+    using Allocator = PoolAllocator<std::pair<const int, int>>;
+    Allocator allocator(with_pages(PageSize::kHuge1G));
+    HashMap<int, int, std::hash<int>, std::equal_to<int>, Allocator> map(std::hash<int>(), std::equal_to<int>(),
+                                                                         allocator);
+    map.set_incremental_rehash(true);
+    std::map<int, int> expected;
+    for (int i = 0; i < 100000; ++i) {
+        map[i * 3] = i;
+        expected[i * 3] = i;
+    }
+    for (int i = 0; i < 100000; i += 2) {
+        map.erase(i * 3);
+        expected.erase(i * 3);
+    }
+    check_against(map, expected);
+
+    size_t reserved = allocator.arena()->reserved_bytes();
+    CHECK(reserved > 0 && reserved % kHugePage == 0 && reserved < (size_t(1) << 30));
+    auto copy = map;
+    check_against(copy, expected);
+    CHECK(copy.get_allocator() != map.get_allocator());
+    CHECK(copy.get_allocator().arena()->options().page_size == PageSize::kHuge1G);
+}
+
+using Allocator = PoolAllocator<std::pair<const int, int>>;
+using PooledMap = HashMap<int, int, std::hash<int>, std::equal_to<int>, Allocator>;
+
+void fill(PooledMap& map, std::map<int, int>& expected, int count) {
+    for (int i = 0; i < count; ++i) {
+        map[i] = -i;
+        expected[i] = -i;
+    }
+}
+
+// A map that holds every node of its arena releases the arena in clear() and in its destructor. A node handle or
+// another map with nodes in the arena makes clear() destroy the elements one by one instead.
+void test_bulk_release() {
+    Allocator allocator;
+    const NodeArena& arena = *allocator.arena();
+    std::map<int, int> expected;
+    {
+        PooledMap map(std::hash<int>(), std::equal_to<int>(), allocator);
+        fill(map, expected, 10000);
+        map.set_incremental_rehash(true);
+        map[10000] = -10000;
+        expected[10000] = -10000;
+        CHECK(arena.live_nodes() == 2 * map.size() && arena.reserved_bytes() > 0);
+        map.clear();
+        CHECK(map.empty() && arena.live_nodes() == 0 && arena.reserved_bytes() == 0);
+        expected.clear();
+        fill(map, expected, 1000);
+        check_against(map, expected);
+
+        auto node = map.extract(7);
+        size_t reserved = arena.reserved_bytes();
+        map.clear();
+        CHECK(map.empty() && arena.live_nodes() == 2 && arena.reserved_bytes() == reserved);
+        CHECK(node.key() == 7 && node.mapped() == -7);
+        map.insert(std::move(node));
+        CHECK(map.at(7) == -7);
+
+        PooledMap other(std::hash<int>(), std::equal_to<int>(), allocator);
+        expected.clear();
+        fill(other, expected, 100);
+        map.clear();
+        check_against(other, expected);
+        CHECK(arena.live_nodes() == 2 * other.size());
+    }
+    // The destructors released the arena, and nothing abandoned with it kept a reference to it.
+    CHECK(arena.live_nodes() == 0 && arena.reserved_bytes() == 0 && allocator.arena().use_count() == 1);
+
+    // Elements with a destructor are destroyed one by one, so the slabs stay for the next elements.
+    using StringAllocator = PoolAllocator<std::pair<const int, std::string>>;
+    StringAllocator strings;
+    HashMap<int, std::string, std::hash<int>, std::equal_to<int>, StringAllocator> named(
+        std::hash<int>(), std::equal_to<int>(), strings);
+    for (int i = 0; i < 1000; ++i)
+        named[i] = "a string too long for the small string buffer";
+    size_t reserved = strings.arena()->reserved_bytes();
+    named.clear();
+    CHECK(strings.arena()->live_nodes() == 0 && strings.arena()->reserved_bytes() == reserved);
+}
+
+}  // namespace
+
+int main() {
+    test_bulk_release();
+    test_mapped_bytes();
+    test_map_pages();
+    test_huge_page_map();
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "rcu_hash_map.h"
+#include "test_support.h"
+
+/**
+ * RcuHashMap: writers on disjoint key ranges and a concurrent reader, checked for what the reader may see and for
+ * the final contents.
+ */
+
+using test_support::kKeysPerThread;
+using test_support::kThreads;
+using test_support::run_threads;
+
+namespace {
+
+void test_rcu() {
+    RcuHashMap<int, std::string> map;
+    std::atomic<bool> done{false};
+    std::thread reader([&map, &done] {
+        while (!done.load()) {
+            for (int i = 0; i < 100; ++i) {
+                auto value = map.find(i);
+                CHECK(!value || *value == std::to_string(i) || *value == "x");
+            }
+        }
+    });
+    run_threads([&map](int t) {
+        for (int i = t * kKeysPerThread; i < (t + 1) * kKeysPerThread; ++i) {
+            CHECK(map.insert({i, std::to_string(i)}));
+            if (i % 2 == 0)
+                map.insert_or_assign(i, std::string("x"));
+            if (i % 5 == 0)
+                CHECK(map.erase(i));
+        }
+    });
+    done.store(true);
+    reader.join();
+    for (int i = 0; i < kThreads * kKeysPerThread; ++i) {
+        auto value = map.find(i);
+        if (i % 5 == 0)
+            CHECK(!value);
+        else
+            CHECK(value && *value == (i % 2 == 0 ? "x" : std::to_string(i)));
+    }
+}
+
+}  // namespace
+
+int main() {
+    test_rcu();
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "small_hash_map.h"
+#include "test_support.h"
+
+/**
+ * SmallHashMap in small and in large mode: a random mix of operations checked against std::map, with copies and
+ * moves, and the state left behind by an exception during the switch to the HashMap, during a move or during an
+ * erase.
+ */
+
+using test_support::check_intact;
+using test_support::FailAfter;
+using test_support::InjectedFailure;
+using test_support::test_rehash_exception;
+using test_support::test_round_trip;
+using test_support::Throwing;
+
+namespace {
+
+// Elements whose move may throw are copied by a move of the map, and a failed copy leaves the source as it was.
+void test_move_exception() {
+    using Map = SmallHashMap<int, Throwing>;
+    Map map;
+    for (int i = 0; i < 5; ++i)
+        map.insert({i, Throwing(i)});
+    {
+        FailAfter failure(2);
+        CHECK_THROWS(Map moved(std::move(map)), InjectedFailure);
+    }
+    check_intact(map, 5);
+
+    Map target;
+    target.insert({7, Throwing(7)});
+    {
+        FailAfter failure(2);
+        CHECK_THROWS(target = std::move(map), InjectedFailure);
+    }
+    check_intact(map, 5);
+    CHECK(target.empty());
+
+    Map moved(std::move(map));
+    check_intact(moved, 5);
+    CHECK(map.empty());
+}
+
+// A throwing copy of the last element leaves the map as it was, and a throwing move into the hole leaves it
+// consistent.
+void test_erase_exception() {
+    using Map = SmallHashMap<int, Throwing>;
+    Map map;
+    for (int i = 0; i < 4; ++i)
+        map.insert({i, Throwing(i)});
+    {
+        FailAfter failure(0);
+        CHECK_THROWS(map.erase(0), InjectedFailure);
+    }
+    check_intact(map, 4);
+
+    map.erase(3);
+    check_intact(map, 3);
+    {
+        FailAfter failure(1);
+        CHECK_THROWS(map.erase(0), InjectedFailure);
+    }
+    CHECK(map.empty());
+    map.insert({0, Throwing(0)});
+    check_intact(map, 1);
+
+    map.insert({1, Throwing(1)});
+    map.erase(0);
+    CHECK(map.size() == 1 && map.find(1)->second.value() == 1);
+}
+
+}  // namespace
+
+int main() {
+    test_round_trip<SmallHashMap<int, int>>(3000);
+    test_round_trip<SmallHashMap<int, int, 8>>(8);
+
+    test_rehash_exception<SmallHashMap<int, Throwing>>(3);
+    test_move_exception();
+    test_erase_exception();
+    return 0;
+}
@@ -0,0 +1,18 @@
+#include "swiss_hash_map.h"
+#include "test_support.h"
+
+/**
+ * SwissHashMap: a random mix of operations checked against std::map, with copies and moves, and the state left behind
+ * by an exception during a rehash.
+ */
+
+using test_support::test_rehash_exception;
+using test_support::test_round_trip;
+using test_support::Throwing;
+
+int main() {
+    test_round_trip<SwissHashMap<int, int>>(3000);
+
+    test_rehash_exception<SwissHashMap<int, Throwing>>(5);
+    return 0;
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Minimal checks for the test executables, and the scenarios several containers share. The checks stay on in release
+ * builds, which is what the tree builds by default, and a failed check ends the test with the location and the
+ * condition.
+ */
+
+#define CHECK(condition)                                                                          \
+    do {                                                                                          \
+        if (!(condition)) {                                                                       \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);   \
+            std::exit(1);                                                                         \
+        }                                                                                         \
+    } while (0)
+
+#define CHECK_THROWS(statement, exception)                                                        \
+    do {                                                                                          \
+        bool thrown = false;                                                                      \
+        try {                                                                                     \
+            statement;                                                                            \
+        } catch (const exception&) {                                                              \
+            thrown = true;                                                                        \
+        }                                                                                         \
+        CHECK(thrown);                                                                            \
+    } while (0)
+
+namespace test_support {
+
+struct InjectedFailure : std::runtime_error {
+    InjectedFailure() : std::runtime_error("injected failure") {}
+};
+
+// Value whose copies and moves throw once a shared budget of them is used up, for the exception paths. A negative
+// budget never runs out.
+class Throwing {
+public:
+    static inline int budget = -1;
+
+    Throwing(int value = 0) : value_(value) {}
+
+    Throwing(const Throwing& other) : value_(other.value_) {
+        spend();
+    }
+
+    Throwing(Throwing&& other) : value_(other.value_) {
+        spend();
+        other.value_ = -1;
+    }
+
+    Throwing& operator= (const Throwing& other) {
+        spend();
+        value_ = other.value_;
+        return *this;
+    }
+
+    Throwing& operator= (Throwing&& other) {
+        spend();
+        value_ = other.value_;
+        other.value_ = -1;
+        return *this;
+    }
+
+    int value() const {
+        return value_;
+    }
+
+private:
+    static void spend() {
+        if (budget == 0)
+            throw InjectedFailure();
+        if (budget > 0)
+            --budget;
+    }
+
+    int value_;
+};
+
+// Sets the budget of Throwing for a scope and turns it off again when the scope ends.
+struct FailAfter {
+    explicit FailAfter(int operations) {
+        Throwing::budget = operations;
+    }
+
+    ~FailAfter() {
+        Throwing::budget = -1;
+    }
+};
+
+// The map holds exactly the elements of 'expected', and iteration visits each of them once.
+template<class Map>
+void check_against(const Map& map, const std::map<int, int>& expected) {
+    CHECK(map.size() == expected.size());
+    for (auto &el : expected) {
+        auto iter = map.find(el.first);
+        CHECK(iter != map.end() && iter->second == el.second);
+    }
+    size_t count = 0;
+    for (auto iter = map.begin(); iter != map.end(); ++iter)
+        ++count;
+    CHECK(count == expected.size());
+}
+
+// A random mix of insert, operator[] and erase checked against std::map, then copies and moves of the result.
+template<class Map>
+void test_round_trip(int key_range) {
+    Map map;
+    std::map<int, int> expected;
+    std::mt19937 random(2);
+    for (int step = 0; step < 50000; ++step) {
+        int key = static_cast<int>(random() % key_range);
+        switch (random() % 4) {
+        case 0:
+            map.insert({key, step});
+            expected.insert({key, step});
+            break;
+        case 1:
+            map[key] = step;
+            expected[key] = step;
+            break;
+        default:
+            map.erase(key);
+            expected.erase(key);
+        }
+    }
+    check_against(map, expected);
+
+    Map copy(map);
+    check_against(copy, expected);
+    Map moved(std::move(copy));
+    check_against(moved, expected);
+    copy = moved;
+    check_against(copy, expected);
+}
+
+// Every element that was in the map before a failed insertion is still there with its value.
+template<class Map>
+void check_intact(const Map& map, int count) {
+    CHECK(map.size() == static_cast<size_t>(count));
+    for (int i = 0; i < count; ++i) {
+        auto iter = map.find(i);
+        CHECK(iter != map.end() && iter->second.value() == i);
+    }
+}
+
+// Fills the map with 0, 1, ... until an insertion that grows the table fails on its 'fail_after'th copy or move.
+template<class Map>
+void test_rehash_exception(int fail_after) {
+    Map map;
+    int count = 0;
+    for (; count < 1000; ++count) {
+        size_t before = map.size();
+        Throwing value(count);
+        bool failed = false;
+        {
+            FailAfter failure(count >= 8 ? fail_after : -1);
+            try {
+                map.insert({count, value});
+            } catch (const InjectedFailure&) {
+                failed = true;
+            }
+        }
+        if (failed) {
+            CHECK(map.size() == before);
+            break;
+        }
+    }
+    CHECK(count < 1000);
+    check_intact(map, count);
+    map.insert({count, Throwing(count)});
+    check_intact(map, count + 1);
+}
+
+constexpr int kThreads = 4;
+constexpr int kKeysPerThread = 5000;
+
+// Runs fn(t) on kThreads threads, t = 0, 1, ..., and waits for all of them.
+template<class F>
+void run_threads(F fn) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+        threads.emplace_back(fn, t);
+    for (auto &thread : threads)
+        thread.join();
+}
+
+}  // namespace test_support
@@ -0,0 +1,42 @@
+#include <atomic>
+#include <thread>
+
+#include "versioned_hash_map.h"
+#include "test_support.h"
+
+/**
+ * VersionedHashMap: a writer publishing versions and a concurrent reader, checked for what every view holds.
+ */
+
+namespace {
+
+void test_versioned() {
+    VersionedHashMap<int, int> map;
+    std::atomic<bool> done{false};
+    std::thread reader([&map, &done] {
+        while (!done.load()) {
+            auto view = map.view();
+            // Version n holds exactly the keys below n * 100.
+            CHECK(view.size() == view.version() * 100);
+            if (view.version() > 0)
+                CHECK(view.contains(static_cast<int>(view.version() * 100 - 1)));
+        }
+    });
+    for (int version = 1; version <= 50; ++version) {
+        map.update([version](HashMap<int, int>& working) {
+            for (int i = (version - 1) * 100; i < version * 100; ++i)
+                working[i] = i;
+        });
+    }
+    done.store(true);
+    reader.join();
+    auto view = map.view();
+    CHECK(view.version() == 50 && view.size() == 5000 && view.at(4999) == 4999);
+}
+
+}  // namespace
+
+int main() {
+    test_versioned();
+    return 0;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+#include "epoch.h"
+#include "hash_map.h"
+
+/**
+ * HashMap for one writer thread and any number of reader threads. The writer edits a private working copy and, after
+ * a batch of changes, publishes it: the copy is cloned (see HashMap::clone_from) into a new immutable version, and
+ * one atomic pointer swap makes it current. Readers take a View, which pins the current version, and do their
+ * lookups on it as on a const HashMap, with no atomics and no locks per lookup; only taking the view costs an epoch
+ * pin. A view keeps seeing the version it started with, whatever gets published meanwhile.
+ * Replaced versions are freed through the EpochDomain once no view can reach them anymore. Every publish clones the
+ * whole map, so publishing pays off for batches of changes rather than for single ones.
+ * edit(), publish() and update() must only be called by the writer; view() may be called by any thread. Views must
+ * not outlive the map.
+ */
+
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class KeyEqual = std::equal_to<KeyType> >
+class VersionedHashMap {
+public:
+    using map_type = HashMap<KeyType, ValueType, Hash, KeyEqual>;
+    using const_iterator = typename map_type::const_iterator;
+
+private:
+    struct Version {
+        Version(const map_type& source, uint64_t version_number) : map(source), number(version_number) {}
+
+        const map_type map;
+        const uint64_t number;
+    };
+
+    map_type working_;
+    std::atomic<Version*> current_;
+    // Touched by the writer only.
+    uint64_t last_version_ = 0;
+
+public:
+    // Pins the version that was current when the view was taken, for as long as the view lives.
+    class View {
+    public:
+        View(const View&) = delete;
+        View& operator= (const View&) = delete;
+
+        const_iterator find(const KeyType& key) const {
+            return version_->map.find(key);
+        }
+
+        bool contains(const KeyType& key) const {
+            return version_->map.find(key) != version_->map.end();
+        }
+
+        const ValueType& at(const KeyType& key) const {
+            return version_->map.at(key);
+        }
+
+        size_t size() const {
+            return version_->map.size();
+        }
+
+        bool empty() const {
+            return version_->map.empty();
+        }
+
+        const_iterator begin() const {
+            return version_->map.begin();
+        }
+        const_iterator end() const {
+            return version_->map.end();
+        }
+
+        // The rest of the const interface, e.g. find_batch.
+        const map_type& map() const {
+            return version_->map;
+        }
+
+        // Number of the publish that made this version, zero for the empty map the constructor publishes.
+        uint64_t version() const {
+            return version_->number;
+        }
+
+    private:
+        friend class VersionedHashMap;
+
+        // The epoch is pinned by guard_ before the pointer is read.
+        explicit View(const std::atomic<Version*>& current) : version_(current.load(std::memory_order_acquire)) {}
+
+        EpochGuard guard_;
+        const Version* version_;
+    };
+
+    explicit VersionedHashMap(Hash hasher_obj = Hash(), const KeyEqual& equal = KeyEqual())
+        : working_(hasher_obj, equal), current_(new Version(working_, 0)) {}
+
+    VersionedHashMap(const VersionedHashMap&) = delete;
+    VersionedHashMap& operator= (const VersionedHashMap&) = delete;
+
+    View view() const {
+        return View(current_);
+    }
+
+    // The working copy; changes to it are invisible to readers until publish().
+    map_type& edit() {
+        return working_;
+    }
+
+    // Makes a snapshot of the working copy the current version and returns its number.
+    uint64_t publish() {
+        Version* fresh = new Version(working_, last_version_ + 1);
+        ++last_version_;
+        Version* old = current_.exchange(fresh, std::memory_order_acq_rel);
+        EpochDomain& domain = EpochDomain::instance();
+        domain.retire(old);
+        // Versions are as large as the map, so they are not left waiting for the domain's batch threshold.
+        domain.reclaim();
+        return last_version_;
+    }
+
+    // Applies fn to the working copy and publishes the result.
+    template<class F>
+    uint64_t update(F&& fn) {
+        std::forward<F>(fn)(working_);
+        return publish();
+    }
+
+    ~VersionedHashMap() {
+        delete current_.load(std::memory_order_relaxed);
+    }
+};